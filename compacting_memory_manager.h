@@ -0,0 +1,585 @@
+#pragma once
+
+namespace dap
+{
+
+namespace memory
+{
+
+struct memory_handle
+{
+	static inline constexpr u32 invalid_index = ~0u;
+
+	bool is_valid() const { return index != invalid_index; };
+
+	u32 index = invalid_index;
+	u32 generation = 0;
+};
+
+struct compacting_manager_statistics : memory_manager_statistics
+{
+	using memory_manager_statistics::memory_manager_statistics;
+
+	size_t live_memory = 0;
+	u32 handles_used = 0;
+	bool compaction_in_progress = false;
+};
+
+// Hands out handles instead of pointers, so live blocks can be moved together and freed blocks do not stay as holes.
+// Pointers from resolve are valid until the next call that allocates or compacts, pin keeps a block in place until unpin.
+// compact moves a bounded amount of bytes and walks a bounded amount of blocks per call and continues where the previous call stopped,
+// when there is no space left for an allocation the pass is finished at once and holes left in front of pinned blocks are reused.
+// Blocks from the memory_manager interface never move, they grow down from the end of the resource in their own region,
+// so they do not get in the way of compaction. Alignment above 16 is not supported.
+class compacting_memory_manager : public memory_manager
+{
+
+public:
+
+	compacting_memory_manager(memory_resource* resource, u32 handle_capacity_);
+
+	memory_allocation_result allocate_aligned(u32 required_memory_size, u16 alignment, const char* file_name, i32 line) override;
+	memory_allocation_result reallocate(memory_block block, u32 required_memory_size, const char* file_name, i32 line) override;
+	void free(memory_block free_block, const char* file_name, i32 line) override;
+	void return_memory(memory_manager* top_allocator) override;
+
+	[[nodiscard]]
+	memory_handle allocate_handle(u32 required_memory_size, const char* file_name, i32 line);
+	// Handle stays the same, content is kept
+	[[nodiscard]]
+	memory_allocation_result_types reallocate_handle(memory_handle handle, u32 required_memory_size, const char* file_name, i32 line);
+	void free_handle(memory_handle handle, const char* file_name, i32 line);
+
+	mem_ptr resolve(memory_handle handle) const;
+	mem_ptr pin(memory_handle handle);
+	void unpin(memory_handle handle);
+
+	static inline constexpr size_t default_compact_visited_blocks = 256;
+
+	// Returns amount of bytes moved
+	size_t compact(size_t max_moved_memory, size_t max_visited_blocks = default_compact_visited_blocks);
+
+	compacting_manager_statistics get_statistics() const;
+
+protected:
+
+	struct block_header
+	{
+		u32 handle_index = free_block_index;
+		u32 block_size = 0;
+		u64 padding = 0;
+	};
+
+	struct handle_entry
+	{
+		mem_ptr memory_ptr = nullptr;
+		u32 memory_size = 0;
+		u32 generation = 0;
+		u32 pin_count = 0;
+		u32 next_free_index = memory_handle::invalid_index;
+	};
+
+	static_assert(sizeof(block_header) == 16);
+
+	static inline constexpr u32 free_block_index = ~0u;
+	static inline constexpr u32 fixed_block_index = ~0u - 1;
+	static inline constexpr u32 block_alignment = 16;
+
+	static MEM_INLINE u32 get_block_size(u32 memory_size)
+	{
+		return (memory_size + sizeof(block_header) + block_alignment - 1) & ~(block_alignment - 1);
+	};
+
+	static MEM_INLINE block_header* get_header(mem_ptr memory_ptr)
+	{
+		return utils::recede_ptr<block_header*>(memory_ptr, sizeof(block_header));
+	};
+
+	handle_entry* get_entry(memory_handle handle) const;
+	void finish_compaction();
+	// First fit over the free blocks of [from, to), neighbouring free blocks are merged on the way
+	mem_ptr take_free_block(mem_ptr from, mem_ptr to, u32 block_size);
+	mem_ptr take_movable_space(u32 block_size);
+	mem_ptr take_fixed_space(u32 block_size);
+	mem_ptr place_block(mem_ptr block_ptr, u32 handle_index, u32 memory_size);
+	void release_block(mem_ptr memory_ptr);
+	void release_fixed_block(block_header* header);
+	void write_free_block(mem_ptr from, mem_ptr to);
+
+	handle_entry* handles = nullptr;
+	u32 handle_capacity = 0;
+	u32 handles_used = 0;
+	u32 first_free_handle = memory_handle::invalid_index;
+
+	mem_ptr blocks_begin = nullptr;
+	mem_ptr blocks_end = nullptr;
+	mem_ptr top_ptr = nullptr;
+	// Blocks of the memory_manager interface take [fixed_bottom, blocks_end)
+	mem_ptr fixed_bottom = nullptr;
+	size_t live_memory = 0;
+
+	// Compaction pass state, blocks are scanned from compact_cursor and moved down to compact_destination
+	mem_ptr compact_cursor = nullptr;
+	mem_ptr compact_destination = nullptr;
+};
+
+compacting_memory_manager::compacting_memory_manager(memory_resource* resource, u32 handle_capacity_) :
+	memory_manager(resource),
+	handle_capacity(handle_capacity_)
+{
+	size_t handles_size = sizeof(handle_entry) * handle_capacity;
+	MEM_ASSERT(resource_info.memory_size() > handles_size + block_alignment * 2);
+
+	blocks_begin = utils::advance_ptr(resource_info.memory_ptr(), utils::get_aligned_distance(resource_info.memory_ptr(), block_alignment));
+	mem_ptr handles_ptr = utils::recede_ptr(end_pointer, handles_size);
+	blocks_end = utils::recede_ptr(handles_ptr, reinterpret_cast<size_t>(handles_ptr) % block_alignment);
+	handles = static_cast<handle_entry*>(blocks_end);
+	for (u32 i = 0; i < handle_capacity; ++i)
+	{
+		new(handles + i) handle_entry{};
+	}
+	top_ptr = blocks_begin;
+	fixed_bottom = blocks_end;
+};
+
+compacting_manager_statistics
+compacting_memory_manager::get_statistics() const
+{
+	compacting_manager_statistics stats(assigned_memory_resouce->get_info());
+	stats.memory_used = utils::get_ptr_distance(top_ptr, blocks_begin) + utils::get_ptr_distance(blocks_end, fixed_bottom);
+	stats.live_memory = live_memory;
+	stats.handles_used = handles_used;
+	stats.compaction_in_progress = compact_cursor != nullptr;
+	return stats;
+};
+
+compacting_memory_manager::handle_entry*
+compacting_memory_manager::get_entry(memory_handle handle) const
+{
+	if (handle.index >= handle_capacity || handles[handle.index].generation != handle.generation || handles[handle.index].memory_ptr == nullptr)
+	{
+		return nullptr;
+	}
+	return &handles[handle.index];
+};
+
+void
+compacting_memory_manager::finish_compaction()
+{
+	bool was_in_progress = compact_cursor != nullptr;
+	compact(~size_t(0), ~size_t(0));
+	if (was_in_progress)
+	{
+		// Holes left before the cursor of the previous pass
+		compact(~size_t(0), ~size_t(0));
+	}
+};
+
+mem_ptr
+compacting_memory_manager::take_free_block(mem_ptr from, mem_ptr to, u32 block_size)
+{
+	for (mem_ptr current = from; current < to;)
+	{
+		block_header* header = static_cast<block_header*>(current);
+		mem_ptr next = utils::advance_ptr(current, header->block_size);
+		if (header->handle_index == free_block_index)
+		{
+			while (next < to && static_cast<block_header*>(next)->handle_index == free_block_index)
+			{
+				next = utils::advance_ptr(next, static_cast<block_header*>(next)->block_size);
+			}
+			header->block_size = static_cast<u32>(utils::get_ptr_distance(next, current));
+
+			if (header->block_size >= block_size)
+			{
+				write_free_block(utils::advance_ptr(current, block_size), next);
+				return current;
+			}
+		}
+		current = next;
+	}
+
+	return nullptr;
+};
+
+mem_ptr
+compacting_memory_manager::take_movable_space(u32 block_size)
+{
+	if (utils::get_ptr_distance(fixed_bottom, top_ptr) < block_size)
+	{
+		finish_compaction();
+	}
+
+	if (utils::get_ptr_distance(fixed_bottom, top_ptr) >= block_size)
+	{
+		mem_ptr block_ptr = top_ptr;
+		top_ptr = utils::advance_ptr(top_ptr, block_size);
+		return block_ptr;
+	}
+
+	// After a finished pass the only free blocks left are holes in front of pinned blocks and blocks freed since
+	return take_free_block(blocks_begin, top_ptr, block_size);
+};
+
+mem_ptr
+compacting_memory_manager::take_fixed_space(u32 block_size)
+{
+	mem_ptr block_ptr = take_free_block(fixed_bottom, blocks_end, block_size);
+	if (block_ptr != nullptr)
+	{
+		return block_ptr;
+	}
+
+	if (utils::get_ptr_distance(fixed_bottom, top_ptr) < block_size)
+	{
+		finish_compaction();
+		if (utils::get_ptr_distance(fixed_bottom, top_ptr) < block_size)
+		{
+			return nullptr;
+		}
+	}
+
+	fixed_bottom = utils::recede_ptr(fixed_bottom, block_size);
+	return fixed_bottom;
+};
+
+mem_ptr
+compacting_memory_manager::place_block(mem_ptr block_ptr, u32 handle_index, u32 memory_size)
+{
+	u32 block_size = get_block_size(memory_size);
+	block_header* header = new(block_ptr) block_header{ handle_index, block_size };
+	live_memory += block_size;
+	return header + 1;
+};
+
+void
+compacting_memory_manager::release_block(mem_ptr memory_ptr)
+{
+	block_header* header = get_header(memory_ptr);
+	header->handle_index = free_block_index;
+	live_memory -= header->block_size;
+
+	mem_ptr block_end = utils::advance_ptr(header, header->block_size);
+	if (block_end == top_ptr && (compact_cursor == nullptr || compact_cursor < header))
+	{
+		top_ptr = header;
+	}
+};
+
+void
+compacting_memory_manager::release_fixed_block(block_header* header)
+{
+	header->handle_index = free_block_index;
+	live_memory -= header->block_size;
+
+	while (fixed_bottom < blocks_end && static_cast<block_header*>(fixed_bottom)->handle_index == free_block_index)
+	{
+		fixed_bottom = utils::advance_ptr(fixed_bottom, static_cast<block_header*>(fixed_bottom)->block_size);
+	}
+};
+
+void
+compacting_memory_manager::write_free_block(mem_ptr from, mem_ptr to)
+{
+	if (from < to)
+	{
+		new(from) block_header{ free_block_index, static_cast<u32>(utils::get_ptr_distance(to, from)) };
+	}
+};
+
+memory_handle
+compacting_memory_manager::allocate_handle(u32 required_memory_size, const char* file_name, i32 line)
+{
+	u32 handle_index = first_free_handle;
+	if (handle_index == memory_handle::invalid_index && handles_used == handle_capacity)
+	{
+		return memory_handle{};
+	}
+
+	mem_ptr block_ptr = take_movable_space(get_block_size(required_memory_size));
+	if (block_ptr == nullptr)
+	{
+		return memory_handle{};
+	}
+
+	if (handle_index != memory_handle::invalid_index)
+	{
+		first_free_handle = handles[handle_index].next_free_index;
+	}
+	else
+	{
+		handle_index = handles_used;
+	}
+	++handles_used;
+
+	handle_entry& entry = handles[handle_index];
+	entry.memory_ptr = place_block(block_ptr, handle_index, required_memory_size);
+	entry.memory_size = required_memory_size;
+	entry.pin_count = 0;
+	entry.next_free_index = memory_handle::invalid_index;
+
+	if (MEM_IS_DEFINED(_DEBUG_LOG_ALLOCATIONS))
+	{}
+
+	return memory_handle{ handle_index, entry.generation };
+};
+
+memory_allocation_result_types
+compacting_memory_manager::reallocate_handle(memory_handle handle, u32 required_memory_size, const char* file_name, i32 line)
+{
+	handle_entry* entry = get_entry(handle);
+	if (entry == nullptr)
+	{
+		DEBUGGER_BREAK();
+		return USE_AFTER_FREE;
+	}
+
+	block_header* header = get_header(entry->memory_ptr);
+	u32 required_block_size = get_block_size(required_memory_size);
+	if (required_block_size <= header->block_size)
+	{
+		entry->memory_size = required_memory_size > entry->memory_size ? required_memory_size : entry->memory_size;
+		return CURRENT_BLOCK_BIG_ENOUGH;
+	}
+
+	mem_ptr block_end = utils::advance_ptr(header, header->block_size);
+	u32 need_more = required_block_size - header->block_size;
+	if (block_end == top_ptr && utils::get_ptr_distance(fixed_bottom, top_ptr) >= need_more)
+	{
+		header->block_size = required_block_size;
+		top_ptr = utils::advance_ptr(top_ptr, need_more);
+		live_memory += need_more;
+		entry->memory_size = required_memory_size;
+		return CONTINUE_CURRENT_BLOCK;
+	}
+
+	// Pinned block can not be moved
+	if (entry->pin_count > 0)
+	{
+		return FAIL;
+	}
+
+	mem_ptr block_ptr = take_movable_space(required_block_size);
+	if (block_ptr == nullptr)
+	{
+		return OUT_OF_MEMORY;
+	}
+
+	// Compaction could have moved the block
+	mem_ptr previous_ptr = entry->memory_ptr;
+	mem_ptr new_ptr = place_block(block_ptr, handle.index, required_memory_size);
+	memcpy(new_ptr, previous_ptr, entry->memory_size);
+	release_block(previous_ptr);
+
+	entry->memory_ptr = new_ptr;
+	entry->memory_size = required_memory_size;
+	return NEW_BLOCK;
+};
+
+void
+compacting_memory_manager::free_handle(memory_handle handle, const char* file_name, i32 line)
+{
+	handle_entry* entry = get_entry(handle);
+	if (entry == nullptr)
+	{
+		DEBUGGER_BREAK();
+		return;
+	}
+
+	release_block(entry->memory_ptr);
+
+	entry->memory_ptr = nullptr;
+	entry->memory_size = 0;
+	entry->pin_count = 0;
+	++entry->generation;
+	entry->next_free_index = first_free_handle;
+	first_free_handle = handle.index;
+	--handles_used;
+
+	if (MEM_IS_DEFINED(_DEBUG_LOG_ALLOCATIONS))
+	{
+		//LOG free
+	}
+};
+
+mem_ptr
+compacting_memory_manager::resolve(memory_handle handle) const
+{
+	handle_entry* entry = get_entry(handle);
+	return entry ? entry->memory_ptr : nullptr;
+};
+
+mem_ptr
+compacting_memory_manager::pin(memory_handle handle)
+{
+	handle_entry* entry = get_entry(handle);
+	if (entry == nullptr)
+	{
+		DEBUGGER_BREAK();
+		return nullptr;
+	}
+
+	MEM_ASSERT(entry->pin_count < ~0u);
+	++entry->pin_count;
+	return entry->memory_ptr;
+};
+
+void
+compacting_memory_manager::unpin(memory_handle handle)
+{
+	handle_entry* entry = get_entry(handle);
+	if (entry == nullptr || entry->pin_count == 0)
+	{
+		DEBUGGER_BREAK();
+		return;
+	}
+	--entry->pin_count;
+};
+
+size_t
+compacting_memory_manager::compact(size_t max_moved_memory, size_t max_visited_blocks)
+{
+	if (compact_cursor == nullptr)
+	{
+		compact_cursor = blocks_begin;
+		compact_destination = blocks_begin;
+	}
+
+	size_t moved_memory = 0;
+	size_t visited_blocks = 0;
+	while (compact_cursor < top_ptr && moved_memory < max_moved_memory && visited_blocks < max_visited_blocks)
+	{
+		++visited_blocks;
+		block_header* header = static_cast<block_header*>(compact_cursor);
+		u32 block_size = header->block_size;
+		mem_ptr next_cursor = utils::advance_ptr(compact_cursor, block_size);
+
+		if (header->handle_index == free_block_index)
+		{
+			compact_cursor = next_cursor;
+			continue;
+		}
+
+		handle_entry& entry = handles[header->handle_index];
+		if (entry.pin_count > 0)
+		{
+			write_free_block(compact_destination, compact_cursor);
+			compact_destination = next_cursor;
+			compact_cursor = next_cursor;
+			continue;
+		}
+
+		if (compact_destination != compact_cursor)
+		{
+			memmove(compact_destination, compact_cursor, block_size);
+			entry.memory_ptr = static_cast<block_header*>(compact_destination) + 1;
+			moved_memory += block_size;
+		}
+
+		compact_destination = utils::advance_ptr(compact_destination, block_size);
+		compact_cursor = next_cursor;
+	}
+
+	if (compact_cursor >= top_ptr)
+	{
+		top_ptr = compact_destination;
+		compact_cursor = nullptr;
+		compact_destination = nullptr;
+	}
+	else
+	{
+		// Keeps the region walkable for the next step
+		write_free_block(compact_destination, compact_cursor);
+	}
+
+	return moved_memory;
+};
+
+memory_allocation_result
+compacting_memory_manager::allocate_aligned(u32 required_memory_size, u16 alignment, const char* file_name, i32 line)
+{
+	if (alignment > block_alignment)
+	{
+		MEM_ASSERT(alignment <= block_alignment);
+		DEBUGGER_BREAK();
+		return memory_allocation_result{ FAIL };
+	}
+
+	mem_ptr block_ptr = take_fixed_space(get_block_size(required_memory_size));
+	if (block_ptr == nullptr)
+	{
+		return memory_allocation_result{ OUT_OF_MEMORY };
+	}
+
+	return memory_allocation_result{ place_block(block_ptr, fixed_block_index, required_memory_size), required_memory_size, alignment, NEW_BLOCK };
+};
+
+memory_allocation_result
+compacting_memory_manager::reallocate(memory_block block, u32 required_memory_size, const char* file_name, i32 line)
+{
+	if (!is_owned(block))
+	{
+		DEBUGGER_BREAK();
+		return memory_allocation_result{ WRONG_MANAGER };
+	}
+
+	if (block.memory_size() >= required_memory_size)
+	{
+		return memory_allocation_result{ block, CURRENT_BLOCK_BIG_ENOUGH };
+	}
+
+	block_header* header = get_header(block.memory_ptr());
+	if (header->handle_index == free_block_index)
+	{
+		return memory_allocation_result{ USE_AFTER_FREE };
+	}
+
+	if (header->handle_index != fixed_block_index)
+	{
+		DEBUGGER_BREAK();
+		return memory_allocation_result{ WRONG_MANAGER };
+	}
+
+	if (get_block_size(required_memory_size) <= header->block_size)
+	{
+		return memory_allocation_result{ block.memory_ptr(), required_memory_size, block.alignment(), CONTINUE_CURRENT_BLOCK };
+	}
+
+	memory_allocation_result result = allocate_aligned(required_memory_size, block.alignment(), file_name, line);
+	if (result.result == NEW_BLOCK)
+	{
+		free(block, file_name, line);
+	}
+	return result;
+};
+
+void
+compacting_memory_manager::free(memory_block freed_block, const char* file_name, i32 line)
+{
+	if (!is_owned(freed_block))
+	{
+		DEBUGGER_BREAK();
+		return;
+	}
+
+	block_header* header = get_header(freed_block.memory_ptr());
+	if (header->handle_index != fixed_block_index)
+	{
+		DEBUGGER_BREAK();
+		return;
+	}
+
+	release_fixed_block(header);
+
+	if (MEM_IS_DEFINED(_DEBUG_LOG_ALLOCATIONS))
+	{
+		//LOG free
+	}
+};
+
+void
+compacting_memory_manager::return_memory(memory_manager* top_allocator) {};
+
+}
+
+}
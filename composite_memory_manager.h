@@ -0,0 +1,472 @@
+#pragma once
+
+namespace dap
+{
+
+namespace memory
+{
+
+// Composite managers do not own memory, they route calls to the managers they were built from.
+// Routing is resolved at compile time: inner managers are called through qualified names, so no virtual dispatch happens
+// between the layers. Composites are memory managers themselves and can be nested.
+// When a block has to move between inner managers on reallocate, the result is NEW_BLOCK and the old block is freed,
+// same as with the arena managers, copying the content is left to the caller.
+
+template<typename Primary, typename Fallback>
+class fallback_memory_manager : public memory_manager
+{
+
+public:
+
+	fallback_memory_manager(Primary& primary_, Fallback& fallback_) : primary(primary_), fallback(fallback_) {};
+
+	memory_allocation_result allocate_aligned(u32 required_memory_size, u16 alignment, const char* file_name, i32 line) override;
+	memory_allocation_result reallocate(memory_block block, u32 required_memory_size, const char* file_name, i32 line) override;
+	void free(memory_block free_block, const char* file_name, i32 line) override;
+	void return_memory(memory_manager* top_allocator) override;
+
+	bool is_owned(mem_ptr ptr) { return primary.Primary::is_owned(ptr) || fallback.Fallback::is_owned(ptr); };
+	bool is_owned(memory_block block) { return is_owned(block.memory_ptr()); };
+
+protected:
+
+	Primary& primary;
+	Fallback& fallback;
+};
+
+template<typename Primary, typename Fallback>
+memory_allocation_result
+fallback_memory_manager<Primary, Fallback>::allocate_aligned(u32 required_memory_size, u16 alignment, const char* file_name, i32 line)
+{
+	memory_allocation_result result = primary.Primary::allocate_aligned(required_memory_size, alignment, file_name, line);
+	if (result.result != OUT_OF_MEMORY)
+	{
+		return result;
+	}
+
+	return fallback.Fallback::allocate_aligned(required_memory_size, alignment, file_name, line);
+};
+
+template<typename Primary, typename Fallback>
+memory_allocation_result
+fallback_memory_manager<Primary, Fallback>::reallocate(memory_block block, u32 required_memory_size, const char* file_name, i32 line)
+{
+	if (fallback.Fallback::is_owned(block))
+	{
+		return fallback.Fallback::reallocate(block, required_memory_size, file_name, line);
+	}
+
+	if (!primary.Primary::is_owned(block))
+	{
+		DEBUGGER_BREAK();
+		return memory_allocation_result{ WRONG_MANAGER };
+	}
+
+	memory_allocation_result result = primary.Primary::reallocate(block, required_memory_size, file_name, line);
+	if (result.result != OUT_OF_MEMORY)
+	{
+		return result;
+	}
+
+	memory_allocation_result moved_result = fallback.Fallback::allocate_aligned(required_memory_size, block.alignment(), file_name, line);
+	if (moved_result.result == NEW_BLOCK)
+	{
+		primary.Primary::free(block, file_name, line);
+	}
+	return moved_result;
+};
+
+template<typename Primary, typename Fallback>
+void
+fallback_memory_manager<Primary, Fallback>::free(memory_block freed_block, const char* file_name, i32 line)
+{
+	if (primary.Primary::is_owned(freed_block))
+	{
+		primary.Primary::free(freed_block, file_name, line);
+	}
+	else if (fallback.Fallback::is_owned(freed_block))
+	{
+		fallback.Fallback::free(freed_block, file_name, line);
+	}
+	else
+	{
+		DEBUGGER_BREAK();
+	}
+};
+
+template<typename Primary, typename Fallback>
+void
+fallback_memory_manager<Primary, Fallback>::return_memory(memory_manager* top_allocator)
+{
+	primary.Primary::return_memory(top_allocator);
+	fallback.Fallback::return_memory(top_allocator);
+};
+
+
+// Routes allocations of up to Threshold bytes to Small and everything bigger to Large.
+// Reallocate and free are routed by ownership, so blocks rounded up by an inner manager go back to the right side.
+template<size_t Threshold, typename Small, typename Large>
+class segregator_memory_manager : public memory_manager
+{
+
+public:
+
+	segregator_memory_manager(Small& small_, Large& large_) : small(small_), large(large_) {};
+
+	memory_allocation_result allocate_aligned(u32 required_memory_size, u16 alignment, const char* file_name, i32 line) override;
+	memory_allocation_result reallocate(memory_block block, u32 required_memory_size, const char* file_name, i32 line) override;
+	void free(memory_block free_block, const char* file_name, i32 line) override;
+	void return_memory(memory_manager* top_allocator) override;
+
+	bool is_owned(mem_ptr ptr) { return small.Small::is_owned(ptr) || large.Large::is_owned(ptr); };
+	bool is_owned(memory_block block) { return is_owned(block.memory_ptr()); };
+
+protected:
+
+	static MEM_INLINE bool is_small(size_t memory_size) { return memory_size <= Threshold; };
+
+	Small& small;
+	Large& large;
+};
+
+template<size_t Threshold, typename Small, typename Large>
+memory_allocation_result
+segregator_memory_manager<Threshold, Small, Large>::allocate_aligned(u32 required_memory_size, u16 alignment, const char* file_name, i32 line)
+{
+	if (is_small(required_memory_size))
+	{
+		return small.Small::allocate_aligned(required_memory_size, alignment, file_name, line);
+	}
+	return large.Large::allocate_aligned(required_memory_size, alignment, file_name, line);
+};
+
+template<size_t Threshold, typename Small, typename Large>
+memory_allocation_result
+segregator_memory_manager<Threshold, Small, Large>::reallocate(memory_block block, u32 required_memory_size, const char* file_name, i32 line)
+{
+	if (large.Large::is_owned(block))
+	{
+		return large.Large::reallocate(block, required_memory_size, file_name, line);
+	}
+
+	if (!small.Small::is_owned(block))
+	{
+		DEBUGGER_BREAK();
+		return memory_allocation_result{ WRONG_MANAGER };
+	}
+
+	if (is_small(required_memory_size) || required_memory_size <= block.memory_size())
+	{
+		return small.Small::reallocate(block, required_memory_size, file_name, line);
+	}
+
+	memory_allocation_result moved_result = large.Large::allocate_aligned(required_memory_size, block.alignment(), file_name, line);
+	if (moved_result.result == NEW_BLOCK)
+	{
+		small.Small::free(block, file_name, line);
+	}
+	return moved_result;
+};
+
+template<size_t Threshold, typename Small, typename Large>
+void
+segregator_memory_manager<Threshold, Small, Large>::free(memory_block freed_block, const char* file_name, i32 line)
+{
+	if (small.Small::is_owned(freed_block))
+	{
+		small.Small::free(freed_block, file_name, line);
+	}
+	else if (large.Large::is_owned(freed_block))
+	{
+		large.Large::free(freed_block, file_name, line);
+	}
+	else
+	{
+		DEBUGGER_BREAK();
+	}
+};
+
+template<size_t Threshold, typename Small, typename Large>
+void
+segregator_memory_manager<Threshold, Small, Large>::return_memory(memory_manager* top_allocator)
+{
+	small.Small::return_memory(top_allocator);
+	large.Large::return_memory(top_allocator);
+};
+
+
+// Spreads sizes in (MinSize, MaxSize] over buckets StepSize wide, each bucket served by its own Manager.
+// Sizes outside of the range fail with OUT_OF_MEMORY, so the bucketizer can be put in front of a fallback or segregator.
+// Reallocate and free look for the bucket that owns the block, starting with the one its size points to.
+template<typename Manager, size_t MinSize, size_t MaxSize, size_t StepSize>
+class bucketizer_memory_manager : public memory_manager
+{
+	static_assert(StepSize > 0 && MinSize < MaxSize);
+	static_assert((MaxSize - MinSize) % StepSize == 0);
+
+public:
+
+	static inline constexpr size_t bucket_count = (MaxSize - MinSize) / StepSize;
+
+	explicit bucketizer_memory_manager(Manager* (&buckets_)[bucket_count]);
+
+	memory_allocation_result allocate_aligned(u32 required_memory_size, u16 alignment, const char* file_name, i32 line) override;
+	memory_allocation_result reallocate(memory_block block, u32 required_memory_size, const char* file_name, i32 line) override;
+	void free(memory_block free_block, const char* file_name, i32 line) override;
+	void return_memory(memory_manager* top_allocator) override;
+
+	bool is_owned(mem_ptr ptr);
+	bool is_owned(memory_block block) { return is_owned(block.memory_ptr()); };
+
+protected:
+
+	static inline constexpr size_t invalid_bucket = bucket_count;
+
+	static MEM_INLINE size_t get_bucket_index(size_t memory_size)
+	{
+		if (memory_size <= MinSize || memory_size > MaxSize)
+		{
+			return invalid_bucket;
+		}
+		return (memory_size - MinSize - 1) / StepSize;
+	};
+
+	size_t get_owner_bucket_index(memory_block block);
+
+	Manager* buckets[bucket_count];
+};
+
+template<typename Manager, size_t MinSize, size_t MaxSize, size_t StepSize>
+bucketizer_memory_manager<Manager, MinSize, MaxSize, StepSize>::bucketizer_memory_manager(Manager* (&buckets_)[bucket_count])
+{
+	for (size_t i = 0; i < bucket_count; ++i)
+	{
+		MEM_ASSERT(buckets_[i] != nullptr);
+		buckets[i] = buckets_[i];
+	}
+};
+
+template<typename Manager, size_t MinSize, size_t MaxSize, size_t StepSize>
+bool
+bucketizer_memory_manager<Manager, MinSize, MaxSize, StepSize>::is_owned(mem_ptr ptr)
+{
+	for (size_t i = 0; i < bucket_count; ++i)
+	{
+		if (buckets[i]->Manager::is_owned(ptr))
+		{
+			return true;
+		}
+	}
+	return false;
+};
+
+template<typename Manager, size_t MinSize, size_t MaxSize, size_t StepSize>
+size_t
+bucketizer_memory_manager<Manager, MinSize, MaxSize, StepSize>::get_owner_bucket_index(memory_block block)
+{
+	size_t bucket_index = get_bucket_index(block.memory_size());
+	if (bucket_index != invalid_bucket && buckets[bucket_index]->Manager::is_owned(block))
+	{
+		return bucket_index;
+	}
+
+	for (size_t i = 0; i < bucket_count; ++i)
+	{
+		if (buckets[i]->Manager::is_owned(block))
+		{
+			return i;
+		}
+	}
+	return invalid_bucket;
+};
+
+template<typename Manager, size_t MinSize, size_t MaxSize, size_t StepSize>
+memory_allocation_result
+bucketizer_memory_manager<Manager, MinSize, MaxSize, StepSize>::allocate_aligned(u32 required_memory_size, u16 alignment, const char* file_name, i32 line)
+{
+	size_t bucket_index = get_bucket_index(required_memory_size);
+	if (bucket_index == invalid_bucket)
+	{
+		return memory_allocation_result{ OUT_OF_MEMORY };
+	}
+	return buckets[bucket_index]->Manager::allocate_aligned(required_memory_size, alignment, file_name, line);
+};
+
+template<typename Manager, size_t MinSize, size_t MaxSize, size_t StepSize>
+memory_allocation_result
+bucketizer_memory_manager<Manager, MinSize, MaxSize, StepSize>::reallocate(memory_block block, u32 required_memory_size, const char* file_name, i32 line)
+{
+	size_t current_bucket_index = get_owner_bucket_index(block);
+	if (current_bucket_index == invalid_bucket)
+	{
+		DEBUGGER_BREAK();
+		return memory_allocation_result{ WRONG_MANAGER };
+	}
+
+	size_t required_bucket_index = get_bucket_index(required_memory_size);
+	if (required_memory_size <= block.memory_size() || required_bucket_index == current_bucket_index)
+	{
+		return buckets[current_bucket_index]->Manager::reallocate(block, required_memory_size, file_name, line);
+	}
+
+	if (required_bucket_index == invalid_bucket)
+	{
+		return memory_allocation_result{ OUT_OF_MEMORY };
+	}
+
+	memory_allocation_result moved_result = buckets[required_bucket_index]->Manager::allocate_aligned(required_memory_size, block.alignment(), file_name, line);
+	if (moved_result.result == NEW_BLOCK)
+	{
+		buckets[current_bucket_index]->Manager::free(block, file_name, line);
+	}
+	return moved_result;
+};
+
+template<typename Manager, size_t MinSize, size_t MaxSize, size_t StepSize>
+void
+bucketizer_memory_manager<Manager, MinSize, MaxSize, StepSize>::free(memory_block freed_block, const char* file_name, i32 line)
+{
+	size_t bucket_index = get_owner_bucket_index(freed_block);
+	if (bucket_index == invalid_bucket)
+	{
+		DEBUGGER_BREAK();
+		return;
+	}
+	buckets[bucket_index]->Manager::free(freed_block, file_name, line);
+};
+
+template<typename Manager, size_t MinSize, size_t MaxSize, size_t StepSize>
+void
+bucketizer_memory_manager<Manager, MinSize, MaxSize, StepSize>::return_memory(memory_manager* top_allocator)
+{
+	for (size_t i = 0; i < bucket_count; ++i)
+	{
+		buckets[i]->Manager::return_memory(top_allocator);
+	}
+};
+
+
+// Every block starts on its own cache line and is padded up to the end of its last line,
+// so hot objects handed to different threads never share a line.
+// Non zero color moves the start of the first block by color lines. With one underlying arena per thread
+// and different colors, same offsets in those arenas fall into different cache sets.
+// The color lines are a block owned by the adapter, it is taken again by reset and clear_and_reset, so the underlying
+// manager should be reset through the adapter. When it does not fit, blocks go without the offset and is_colored is false.
+template<typename Manager, u16 LineSize = 64>
+class cache_line_memory_manager : public memory_manager
+{
+	static_assert(LineSize >= 16 && (LineSize & (LineSize - 1)) == 0);
+
+public:
+
+	static inline constexpr u16 line_size = LineSize;
+
+	explicit cache_line_memory_manager(Manager& manager_, u32 color_ = 0);
+	~cache_line_memory_manager() override;
+
+	memory_allocation_result allocate_aligned(u32 required_memory_size, u16 alignment, const char* file_name, i32 line) override;
+	memory_allocation_result reallocate(memory_block block, u32 required_memory_size, const char* file_name, i32 line) override;
+	void free(memory_block free_block, const char* file_name, i32 line) override;
+	void return_memory(memory_manager* top_allocator) override { manager.Manager::return_memory(top_allocator); };
+
+	bool is_owned(mem_ptr ptr) { return manager.Manager::is_owned(ptr); };
+	bool is_owned(memory_block block) { return is_owned(block.memory_ptr()); };
+
+	void reset(const char* file_name, i32 line);
+	void clear_and_reset(const char* file_name, i32 line);
+
+	bool is_colored() const { return color == 0 || color_block.memory_ptr() != nullptr; };
+
+protected:
+
+	static MEM_INLINE u32 get_line_rounded_size(u32 memory_size) { return (memory_size + LineSize - 1) & ~static_cast<u32>(LineSize - 1); };
+	static MEM_INLINE u16 get_line_alignment(u16 alignment) { return alignment > LineSize ? alignment : LineSize; };
+
+	// Blocks may come back with the size and alignment the caller asked for, i.e. from destroy
+	static MEM_INLINE memory_block get_line_block(memory_block block)
+	{
+		return memory_block{ block.memory_ptr(), get_line_rounded_size(static_cast<u32>(block.memory_size())), get_line_alignment(block.alignment()) };
+	};
+
+	void apply_color(const char* file_name, i32 line);
+
+	Manager& manager;
+	u32 color = 0;
+	memory_block color_block{};
+};
+
+template<typename Manager, u16 LineSize>
+cache_line_memory_manager<Manager, LineSize>::cache_line_memory_manager(Manager& manager_, u32 color_) :
+	manager(manager_),
+	color(color_)
+{
+	apply_color(ACI);
+};
+
+template<typename Manager, u16 LineSize>
+cache_line_memory_manager<Manager, LineSize>::~cache_line_memory_manager()
+{
+	if (color_block.memory_ptr() != nullptr)
+	{
+		manager.Manager::free(color_block, ACI);
+	}
+};
+
+template<typename Manager, u16 LineSize>
+void
+cache_line_memory_manager<Manager, LineSize>::apply_color(const char* file_name, i32 line)
+{
+	if (color == 0)
+	{
+		return;
+	}
+
+	memory_allocation_result result = manager.Manager::allocate_aligned(color * LineSize, LineSize, file_name, line);
+	if (result.result == NEW_BLOCK)
+	{
+		color_block = result.block;
+	}
+};
+
+template<typename Manager, u16 LineSize>
+void
+cache_line_memory_manager<Manager, LineSize>::reset(const char* file_name, i32 line)
+{
+	manager.Manager::reset(file_name, line);
+	color_block = {};
+	apply_color(file_name, line);
+};
+
+template<typename Manager, u16 LineSize>
+void
+cache_line_memory_manager<Manager, LineSize>::clear_and_reset(const char* file_name, i32 line)
+{
+	manager.Manager::clear_and_reset(file_name, line);
+	color_block = {};
+	apply_color(file_name, line);
+};
+
+template<typename Manager, u16 LineSize>
+memory_allocation_result
+cache_line_memory_manager<Manager, LineSize>::allocate_aligned(u32 required_memory_size, u16 alignment, const char* file_name, i32 line)
+{
+	return manager.Manager::allocate_aligned(get_line_rounded_size(required_memory_size), get_line_alignment(alignment), file_name, line);
+};
+
+template<typename Manager, u16 LineSize>
+memory_allocation_result
+cache_line_memory_manager<Manager, LineSize>::reallocate(memory_block block, u32 required_memory_size, const char* file_name, i32 line)
+{
+	return manager.Manager::reallocate(get_line_block(block), get_line_rounded_size(required_memory_size), file_name, line);
+};
+
+template<typename Manager, u16 LineSize>
+void
+cache_line_memory_manager<Manager, LineSize>::free(memory_block freed_block, const char* file_name, i32 line)
+{
+	manager.Manager::free(get_line_block(freed_block), file_name, line);
+};
+
+}
+
+}
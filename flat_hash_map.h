@@ -0,0 +1,543 @@
+#pragma once
+
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace dap
+{
+
+// Open addressing map with SwissTable-like control bytes, probed a group of 16 at a time.
+// Slots and control bytes live in a single block of the given manager, growth goes through reallocate first,
+// so while the table is the last block of a bump or stack arena it grows in place and is rehashed without a second block.
+// Returned pointers are valid until the next insertion.
+// Maps living in an arena that is about to be reset can be dropped with abandon, nothing is destroyed or freed one by one.
+template<typename K, typename V, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K>>
+class flat_hash_map
+{
+
+public:
+
+	struct entry
+	{
+		K key;
+		V value;
+	};
+
+	explicit flat_hash_map(memory::memory_manager& manager_, Hash hasher_ = Hash{}, KeyEqual key_equal_ = KeyEqual{}) :
+		manager(&manager_),
+		hasher(hasher_),
+		key_equal(key_equal_)
+	{};
+
+	flat_hash_map(flat_hash_map&& other);
+	~flat_hash_map();
+
+	flat_hash_map(flat_hash_map&) = delete;
+	flat_hash_map& operator=(const flat_hash_map&) = delete;
+
+	size_t size() const { return entries_count; };
+	size_t capacity() const { return slots_count; };
+	bool empty() const { return entries_count == 0; };
+
+	V* find(const K& key);
+	const V* find(const K& key) const;
+	bool contains(const K& key) const { return find(key) != nullptr; };
+
+	// Returns value of the existing entry or of the new one constructed from args, nullptr when the manager is out of memory
+	template<typename ...Args>
+	V* try_emplace(const K& key, Args&&... args);
+
+	bool erase(const K& key);
+	void clear();
+	[[nodiscard]] bool reserve(size_t required_entries_count);
+
+	// Forgets storage without destroying entries or freeing memory, for maps dropped together with their arena
+	void abandon();
+
+	template<typename Function>
+	void for_each(Function&& function);
+
+protected:
+
+	typedef signed char ctrl_t;
+
+	static inline constexpr ctrl_t ctrl_empty = -128;
+	static inline constexpr ctrl_t ctrl_deleted = -2;
+	static inline constexpr size_t group_width = 16;
+	static inline constexpr size_t min_capacity = 16;
+	static inline constexpr size_t not_found = ~size_t(0);
+	static inline constexpr memory::u16 storage_alignment = alignof(entry) > 16 ? alignof(entry) : 16;
+
+	static MEM_INLINE bool is_full(ctrl_t ctrl_byte) { return ctrl_byte >= 0; };
+	static MEM_INLINE size_t get_h1(size_t hash) { return hash >> 7; };
+	static MEM_INLINE ctrl_t get_h2(size_t hash) { return static_cast<ctrl_t>(hash & 0x7F); };
+	static MEM_INLINE size_t get_growth_limit(size_t capacity) { return capacity - capacity / 8; };
+	static MEM_INLINE size_t get_storage_size(size_t capacity) { return capacity * sizeof(entry) + capacity + group_width; };
+
+	static MEM_INLINE memory::u32 count_trailing_zeros(memory::u32 mask);
+	static MEM_INLINE memory::u32 match_byte(const ctrl_t* group, ctrl_t value);
+	static MEM_INLINE memory::u32 match_empty_or_deleted(const ctrl_t* group);
+
+	size_t hash_key(const K& key) const;
+	size_t find_index(const K& key, size_t hash) const;
+	size_t find_first_non_full(size_t hash) const;
+	void set_ctrl(size_t index, ctrl_t value);
+	void move_entry(entry* to, entry* from);
+
+	bool make_room();
+	bool grow(size_t new_capacity);
+	void rehash_in_place();
+	void rehash_deleted();
+
+	memory::memory_manager* manager = nullptr;
+	memory::memory_block storage{};
+	entry* slots = nullptr;
+	ctrl_t* ctrl = nullptr;
+	size_t slots_count = 0;
+	size_t entries_count = 0;
+	size_t growth_left = 0;
+	Hash hasher;
+	KeyEqual key_equal;
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+flat_hash_map<K, V, Hash, KeyEqual>::flat_hash_map(flat_hash_map&& other) :
+	manager(other.manager),
+	storage(other.storage),
+	slots(other.slots),
+	ctrl(other.ctrl),
+	slots_count(other.slots_count),
+	entries_count(other.entries_count),
+	growth_left(other.growth_left),
+	hasher(std::move(other.hasher)),
+	key_equal(std::move(other.key_equal))
+{
+	other.abandon();
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+flat_hash_map<K, V, Hash, KeyEqual>::~flat_hash_map()
+{
+	if (slots_count == 0)
+	{
+		return;
+	}
+
+	clear();
+	manager->free(storage, ACI);
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+memory::u32
+flat_hash_map<K, V, Hash, KeyEqual>::count_trailing_zeros(memory::u32 mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index = 0;
+	_BitScanForward(&index, mask);
+	return static_cast<memory::u32>(index);
+#else
+	return static_cast<memory::u32>(__builtin_ctz(mask));
+#endif
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+memory::u32
+flat_hash_map<K, V, Hash, KeyEqual>::match_byte(const ctrl_t* group, ctrl_t value)
+{
+#ifdef MEM_HAS_SSE2
+	__m128i ctrl_group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+	return static_cast<memory::u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(value), ctrl_group)));
+#else
+	memory::u32 mask = 0;
+	for (size_t i = 0; i < group_width; ++i)
+	{
+		mask |= static_cast<memory::u32>(group[i] == value) << i;
+	}
+	return mask;
+#endif
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+memory::u32
+flat_hash_map<K, V, Hash, KeyEqual>::match_empty_or_deleted(const ctrl_t* group)
+{
+#ifdef MEM_HAS_SSE2
+	// Only empty and deleted have the sign bit set
+	return static_cast<memory::u32>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+#else
+	memory::u32 mask = 0;
+	for (size_t i = 0; i < group_width; ++i)
+	{
+		mask |= static_cast<memory::u32>(group[i] < 0) << i;
+	}
+	return mask;
+#endif
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+size_t
+flat_hash_map<K, V, Hash, KeyEqual>::hash_key(const K& key) const
+{
+	// std::hash of integers is identity, mix so both h1 and h2 get entropy
+	memory::u64 hash = static_cast<memory::u64>(hasher(key)) * 0x9E3779B97F4A7C15ull;
+	return static_cast<size_t>(hash ^ (hash >> 32));
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+size_t
+flat_hash_map<K, V, Hash, KeyEqual>::find_index(const K& key, size_t hash) const
+{
+	if (slots_count == 0)
+	{
+		return not_found;
+	}
+
+	size_t mask = slots_count - 1;
+	size_t position = get_h1(hash) & mask;
+	ctrl_t h2 = get_h2(hash);
+	for (size_t step = group_width; ; step += group_width)
+	{
+		const ctrl_t* group = ctrl + position;
+		for (memory::u32 matches = match_byte(group, h2); matches != 0; matches &= matches - 1)
+		{
+			size_t index = (position + count_trailing_zeros(matches)) & mask;
+			if (key_equal(slots[index].key, key))
+			{
+				return index;
+			}
+		}
+
+		if (match_byte(group, ctrl_empty) != 0)
+		{
+			return not_found;
+		}
+		position = (position + step) & mask;
+	}
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+size_t
+flat_hash_map<K, V, Hash, KeyEqual>::find_first_non_full(size_t hash) const
+{
+	size_t mask = slots_count - 1;
+	size_t position = get_h1(hash) & mask;
+	for (size_t step = group_width; ; step += group_width)
+	{
+		memory::u32 matches = match_empty_or_deleted(ctrl + position);
+		if (matches != 0)
+		{
+			return (position + count_trailing_zeros(matches)) & mask;
+		}
+		position = (position + step) & mask;
+	}
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+void
+flat_hash_map<K, V, Hash, KeyEqual>::set_ctrl(size_t index, ctrl_t value)
+{
+	ctrl[index] = value;
+	// First group is mirrored after the end, so groups can be loaded at any position
+	if (index < group_width)
+	{
+		ctrl[slots_count + index] = value;
+	}
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+void
+flat_hash_map<K, V, Hash, KeyEqual>::move_entry(entry* to, entry* from)
+{
+	new(&to->key) K(std::move(from->key));
+	new(&to->value) V(std::move(from->value));
+	from->~entry();
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+V*
+flat_hash_map<K, V, Hash, KeyEqual>::find(const K& key)
+{
+	size_t index = find_index(key, hash_key(key));
+	return index == not_found ? nullptr : &slots[index].value;
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+const V*
+flat_hash_map<K, V, Hash, KeyEqual>::find(const K& key) const
+{
+	size_t index = find_index(key, hash_key(key));
+	return index == not_found ? nullptr : &slots[index].value;
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+template<typename ...Args>
+V*
+flat_hash_map<K, V, Hash, KeyEqual>::try_emplace(const K& key, Args&&... args)
+{
+	size_t hash = hash_key(key);
+	size_t index = find_index(key, hash);
+	if (index != not_found)
+	{
+		return &slots[index].value;
+	}
+
+	if (growth_left == 0 && !make_room())
+	{
+		return nullptr;
+	}
+
+	index = find_first_non_full(hash);
+	if (ctrl[index] == ctrl_empty)
+	{
+		--growth_left;
+	}
+
+	new(&slots[index].key) K(key);
+	new(&slots[index].value) V(std::forward<Args>(args)...);
+	set_ctrl(index, get_h2(hash));
+	++entries_count;
+	return &slots[index].value;
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+bool
+flat_hash_map<K, V, Hash, KeyEqual>::erase(const K& key)
+{
+	size_t index = find_index(key, hash_key(key));
+	if (index == not_found)
+	{
+		return false;
+	}
+
+	slots[index].~entry();
+	set_ctrl(index, ctrl_deleted);
+	--entries_count;
+	return true;
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+void
+flat_hash_map<K, V, Hash, KeyEqual>::clear()
+{
+	if (slots_count == 0)
+	{
+		return;
+	}
+
+	if constexpr (!std::is_trivially_destructible_v<entry>)
+	{
+		for (size_t i = 0; i < slots_count; ++i)
+		{
+			if (is_full(ctrl[i]))
+			{
+				slots[i].~entry();
+			}
+		}
+	}
+
+	memset(ctrl, ctrl_empty, slots_count + group_width);
+	entries_count = 0;
+	growth_left = get_growth_limit(slots_count);
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+bool
+flat_hash_map<K, V, Hash, KeyEqual>::reserve(size_t required_entries_count)
+{
+	size_t new_capacity = slots_count > min_capacity ? slots_count : min_capacity;
+	while (get_growth_limit(new_capacity) < required_entries_count)
+	{
+		new_capacity *= 2;
+	}
+	return new_capacity <= slots_count || grow(new_capacity);
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+void
+flat_hash_map<K, V, Hash, KeyEqual>::abandon()
+{
+	storage = {};
+	slots = nullptr;
+	ctrl = nullptr;
+	slots_count = 0;
+	entries_count = 0;
+	growth_left = 0;
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+template<typename Function>
+void
+flat_hash_map<K, V, Hash, KeyEqual>::for_each(Function&& function)
+{
+	for (size_t i = 0; i < slots_count; ++i)
+	{
+		if (is_full(ctrl[i]))
+		{
+			function(static_cast<const K&>(slots[i].key), slots[i].value);
+		}
+	}
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+bool
+flat_hash_map<K, V, Hash, KeyEqual>::make_room()
+{
+	if (slots_count == 0)
+	{
+		return grow(min_capacity);
+	}
+
+	// Mostly tombstones, cleaning them up is enough
+	if (entries_count <= get_growth_limit(slots_count) / 2)
+	{
+		rehash_in_place();
+		return true;
+	}
+
+	return grow(slots_count * 2);
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+bool
+flat_hash_map<K, V, Hash, KeyEqual>::grow(size_t new_capacity)
+{
+	size_t new_storage_size = get_storage_size(new_capacity);
+	if (new_storage_size > static_cast<memory::u32>(~0u))
+	{
+		return false;
+	}
+
+	if (slots_count == 0)
+	{
+		memory::memory_allocation_result result = manager->allocate_aligned(static_cast<memory::u32>(new_storage_size), storage_alignment, ACI);
+		if (result.result != memory::NEW_BLOCK)
+		{
+			return false;
+		}
+
+		storage = result.block;
+		slots = static_cast<entry*>(storage.memory_ptr());
+		ctrl = memory::utils::advance_ptr<ctrl_t*>(slots, new_capacity * sizeof(entry));
+		slots_count = new_capacity;
+		memset(ctrl, ctrl_empty, new_capacity + group_width);
+		growth_left = get_growth_limit(new_capacity);
+		return true;
+	}
+
+	memory::memory_allocation_result result = manager->reallocate(storage, static_cast<memory::u32>(new_storage_size), ACI);
+	if (result.result == memory::CONTINUE_CURRENT_BLOCK || result.result == memory::CURRENT_BLOCK_BIG_ENOUGH)
+	{
+		// Grown in place, slots stay where they are and are rehashed without a second table
+		size_t old_capacity = slots_count;
+		ctrl_t* new_ctrl = memory::utils::advance_ptr<ctrl_t*>(slots, new_capacity * sizeof(entry));
+		memmove(new_ctrl, ctrl, old_capacity);
+		for (size_t i = 0; i < old_capacity; ++i)
+		{
+			new_ctrl[i] = is_full(new_ctrl[i]) ? ctrl_deleted : ctrl_empty;
+		}
+		memset(new_ctrl + old_capacity, ctrl_empty, new_capacity - old_capacity);
+		memcpy(new_ctrl + new_capacity, new_ctrl, group_width);
+
+		storage = result.block;
+		ctrl = new_ctrl;
+		slots_count = new_capacity;
+		rehash_deleted();
+		growth_left = get_growth_limit(slots_count) - entries_count;
+		return true;
+	}
+
+	if (result.result != memory::NEW_BLOCK)
+	{
+		return false;
+	}
+
+	// Same as with the arena managers, the old block stays readable until the next allocation
+	entry* old_slots = slots;
+	ctrl_t* old_ctrl = ctrl;
+	size_t old_capacity = slots_count;
+
+	storage = result.block;
+	slots = static_cast<entry*>(storage.memory_ptr());
+	ctrl = memory::utils::advance_ptr<ctrl_t*>(slots, new_capacity * sizeof(entry));
+	slots_count = new_capacity;
+	memset(ctrl, ctrl_empty, new_capacity + group_width);
+
+	for (size_t i = 0; i < old_capacity; ++i)
+	{
+		if (is_full(old_ctrl[i]))
+		{
+			size_t hash = hash_key(old_slots[i].key);
+			size_t index = find_first_non_full(hash);
+			move_entry(&slots[index], &old_slots[i]);
+			set_ctrl(index, get_h2(hash));
+		}
+	}
+
+	growth_left = get_growth_limit(slots_count) - entries_count;
+	return true;
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+void
+flat_hash_map<K, V, Hash, KeyEqual>::rehash_in_place()
+{
+	for (size_t i = 0; i < slots_count; ++i)
+	{
+		ctrl[i] = is_full(ctrl[i]) ? ctrl_deleted : ctrl_empty;
+	}
+	memcpy(ctrl + slots_count, ctrl, group_width);
+
+	rehash_deleted();
+	growth_left = get_growth_limit(slots_count) - entries_count;
+};
+
+// Entries marked deleted still have to be placed, they are moved to their first free slot,
+// kept where they are when that slot is in the same group, or swapped with another entry waiting for placement.
+template<typename K, typename V, typename Hash, typename KeyEqual>
+void
+flat_hash_map<K, V, Hash, KeyEqual>::rehash_deleted()
+{
+	size_t mask = slots_count - 1;
+	alignas(entry) unsigned char swap_memory[sizeof(entry)];
+	entry* swap_entry = reinterpret_cast<entry*>(swap_memory);
+
+	for (size_t i = 0; i < slots_count; ++i)
+	{
+		if (ctrl[i] != ctrl_deleted)
+		{
+			continue;
+		}
+
+		size_t hash = hash_key(slots[i].key);
+		size_t probe_start = get_h1(hash) & mask;
+		size_t target = find_first_non_full(hash);
+		auto get_probe_group = [&](size_t position) { return ((position - probe_start) & mask) / group_width; };
+
+		if (get_probe_group(target) == get_probe_group(i))
+		{
+			set_ctrl(i, get_h2(hash));
+			continue;
+		}
+
+		if (ctrl[target] == ctrl_empty)
+		{
+			move_entry(&slots[target], &slots[i]);
+			set_ctrl(target, get_h2(hash));
+			set_ctrl(i, ctrl_empty);
+			continue;
+		}
+
+		move_entry(swap_entry, &slots[target]);
+		move_entry(&slots[target], &slots[i]);
+		move_entry(&slots[i], swap_entry);
+		set_ctrl(target, get_h2(hash));
+		--i;
+	}
+};
+
+}
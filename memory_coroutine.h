@@ -0,0 +1,125 @@
+#pragma once
+
+#include <memory>
+#include <new>
+
+namespace dap
+{
+
+namespace memory
+{
+
+// Makes coroutine frames of the promise type come from a memory manager:
+//
+//	struct promise_type : dap::memory::coroutine_frame_memory { ... };
+//
+// The manager is taken from the coroutine arguments when they start with (std::allocator_arg, manager, ...),
+// for member coroutines after the object itself, otherwise from the innermost coroutine_memory_scope of the calling thread.
+// Without either, or when the manager is out of memory, the frame falls back to the global operator new.
+// Every frame remembers its manager, so frames can outlive the scope that created them.
+
+class coroutine_memory_scope
+{
+
+public:
+
+	explicit coroutine_memory_scope(memory_manager& manager) : previous_manager(current_manager)
+	{
+		current_manager = &manager;
+	};
+
+	~coroutine_memory_scope() { current_manager = previous_manager; };
+
+	coroutine_memory_scope(coroutine_memory_scope&) = delete;
+	coroutine_memory_scope& operator=(const coroutine_memory_scope&) = delete;
+
+	static memory_manager* get_current_manager() { return current_manager; };
+
+protected:
+
+	static inline thread_local memory_manager* current_manager = nullptr;
+
+	memory_manager* previous_manager = nullptr;
+};
+
+struct coroutine_frame_memory
+{
+	static void* operator new(size_t frame_size)
+	{
+		return allocate_frame(coroutine_memory_scope::get_current_manager(), frame_size);
+	};
+
+	template<typename ...Args>
+	static void* operator new(size_t frame_size, std::allocator_arg_t, memory_manager& manager, Args&...)
+	{
+		return allocate_frame(&manager, frame_size);
+	};
+
+	template<typename This, typename ...Args>
+	static void* operator new(size_t frame_size, This&, std::allocator_arg_t, memory_manager& manager, Args&...)
+	{
+		return allocate_frame(&manager, frame_size);
+	};
+
+	static void operator delete(void* frame, size_t frame_size)
+	{
+		free_frame(frame, frame_size);
+	};
+
+protected:
+
+	struct frame_header
+	{
+		memory_manager* manager = nullptr;
+	};
+
+	static inline constexpr u16 frame_alignment = 16;
+	static inline constexpr size_t frame_header_size = (sizeof(frame_header) + frame_alignment - 1) & ~static_cast<size_t>(frame_alignment - 1);
+
+	static void* allocate_frame(memory_manager* manager, size_t frame_size);
+	static void free_frame(void* frame, size_t frame_size);
+};
+
+void*
+coroutine_frame_memory::allocate_frame(memory_manager* manager, size_t frame_size)
+{
+	size_t block_size = frame_size + frame_header_size;
+	mem_ptr block_ptr = nullptr;
+
+	if (manager != nullptr && block_size <= static_cast<u32>(~0u))
+	{
+		memory_allocation_result result = manager->allocate_aligned(static_cast<u32>(block_size), frame_alignment, ACI);
+		if (result.result == NEW_BLOCK)
+		{
+			block_ptr = result.block.memory_ptr();
+		}
+	}
+
+	if (block_ptr == nullptr)
+	{
+		manager = nullptr;
+		block_ptr = ::operator new(block_size);
+	}
+
+	new(block_ptr) frame_header{ manager };
+	return utils::advance_ptr(block_ptr, frame_header_size);
+};
+
+void
+coroutine_frame_memory::free_frame(void* frame, size_t frame_size)
+{
+	mem_ptr block_ptr = utils::recede_ptr(frame, frame_header_size);
+	memory_manager* manager = static_cast<frame_header*>(block_ptr)->manager;
+
+	if (manager == nullptr)
+	{
+		::operator delete(block_ptr);
+		return;
+	}
+
+	manager->free({ block_ptr, frame_size + frame_header_size, frame_alignment }, ACI);
+};
+
+}
+
+}
@@ -1,5 +1,19 @@
 #pragma once
 
+#include <cstring>
+
+#if !defined(DAP_NO_SIMD) && (defined(_M_X64) || defined(__SSE2__))
+#define MEM_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+// Releases pages so they read back as zero and returns true on success. os_pages tells the memory came from
+// memory_resource_manager, by default only such pages are discarded. Override it to discard pages of other resources
+// too, i.e. madvise(MADV_DONTNEED) on private anonymous mappings, or to never discard with false.
+#ifndef MEM_DISCARD_PAGES
+#define MEM_DISCARD_PAGES(ptr, size, os_pages) ((os_pages) && memory_resource_manager::discard_pages(ptr, size))
+#endif
+
 #ifndef DAP_SUPPRESS_DEBUG_BREAK
 #define DEBUGGER_BREAK() __debugbreak()
 #else
@@ -72,6 +86,75 @@ recede_ptr(mem_ptr ptr, size_t recede)
 	return reinterpret_cast<mem_ptr>(reinterpret_cast<size_t>(ptr) - recede);
 }
 
+static inline constexpr size_t streaming_clear_threshold = 256 * 1024;
+static inline constexpr size_t page_discard_threshold = 4 * 1024 * 1024;
+
+// Non-temporal stores, cleared memory is not pulled into the cache
+MEM_INLINE void
+stream_clear_memory(mem_ptr ptr, size_t size)
+{
+#ifdef MEM_HAS_SSE2
+	size_t head_size = get_aligned_distance(ptr, 16);
+	if (head_size >= size)
+	{
+		memset(ptr, 0x00, size);
+		return;
+	}
+
+	memset(ptr, 0x00, head_size);
+	__m128i* current = advance_ptr<__m128i*>(ptr, head_size);
+	size_t vectors_count = (size - head_size) / sizeof(__m128i);
+	size_t tail_size = (size - head_size) % sizeof(__m128i);
+	const __m128i zero = _mm_setzero_si128();
+
+	size_t i = 0;
+	for (; i + 4 <= vectors_count; i += 4)
+	{
+		_mm_stream_si128(current + i, zero);
+		_mm_stream_si128(current + i + 1, zero);
+		_mm_stream_si128(current + i + 2, zero);
+		_mm_stream_si128(current + i + 3, zero);
+	}
+	for (; i < vectors_count; ++i)
+	{
+		_mm_stream_si128(current + i, zero);
+	}
+	_mm_sfence();
+
+	memset(current + vectors_count, 0x00, tail_size);
+#else
+	memset(ptr, 0x00, size);
+#endif
+}
+
+// Small regions are cleared through the cache, as they are likely to be used right away,
+// medium ones with streaming stores and large ones are given back to the OS page by page if MEM_DISCARD_PAGES allows it.
+MEM_INLINE void
+clear_memory(mem_ptr ptr, size_t size, bool os_pages)
+{
+	if (size < streaming_clear_threshold)
+	{
+		memset(ptr, 0x00, size);
+		return;
+	}
+
+	if (size >= page_discard_threshold)
+	{
+		constexpr u16 page_size = memory_resource_manager::os_page_size;
+		size_t head_size = get_aligned_distance(ptr, page_size);
+		mem_ptr pages_ptr = advance_ptr(ptr, head_size);
+		size_t pages_size = (size - head_size) & ~static_cast<size_t>(page_size - 1);
+		if (MEM_DISCARD_PAGES(pages_ptr, pages_size, os_pages))
+		{
+			memset(ptr, 0x00, head_size);
+			memset(advance_ptr(pages_ptr, pages_size), 0x00, size - head_size - pages_size);
+			return;
+		}
+	}
+
+	stream_clear_memory(ptr, size);
+}
+
 }
 
 enum memory_allocation_result_types
@@ -159,8 +242,11 @@ public:
 protected:
 
 	memory_block resource_info;
-	mem_ptr end_pointer;
-	memory_resource* assigned_memory_resouce;
+	mem_ptr end_pointer = nullptr;
+	memory_resource* assigned_memory_resouce = nullptr;
+
+	// Resource came from memory_resource_manager, its pages can be given back to the OS
+	bool has_os_pages() const { return assigned_memory_resouce->get_growth_type() == memory_resource_growth_type::COMMIT_ALL; };
 
 };
 
@@ -195,6 +281,14 @@ void memory_manager::destroy(T* memory_ptr)
 struct bump_manager_statistics : memory_manager_statistics
 {
 	using memory_manager_statistics::memory_manager_statistics;
+
+	size_t segments_count = 0;
+};
+
+struct bump_segment_header
+{
+	bump_segment_header* previous_segment = nullptr;
+	memory_resource segment_resource{};
 };
 
 class bump_memory_manager : public memory_manager
@@ -203,17 +297,49 @@ class bump_memory_manager : public memory_manager
 public:
 
 	explicit bump_memory_manager(memory_resource* resource);
+	// Growable mode, when resource is full new segments are requested from segment_source, each twice the size of previous one.
+	// Segments are chained and given back on reset, reallocate of a block from an older segment moves it to the current one.
+	bump_memory_manager(memory_resource* resource, memory_resource_manager* segment_source_);
+	~bump_memory_manager() override;
 
 	memory_allocation_result allocate_aligned(u32 required_memory_size, u16 alignment, const char* file_name, i32 line) override;
 	memory_allocation_result reallocate(memory_block block, u32 required_memory_size, const char* file_name, i32 line) override;
 	void free(memory_block free_block, const char* file_name, i32 line) override;
 	void return_memory(memory_manager* top_allocator) override;
 
+	// Clears only the part of the block that was used since the last clear_and_reset
+	[[nodiscard]]
+	memory_allocation_result allocate_zeroed(u32 required_memory_size, u16 alignment, const char* file_name, i32 line);
+
+	void reset(const char* file_name, i32 line);
+	void clear_and_reset(const char* file_name, i32 line);
+
+	// Blocks from older segments are owned too, they are left in place until reset
+	bool is_owned(mem_ptr ptr) { return memory_manager::is_owned(ptr) || is_owned_by_previous_segments(ptr); };
+	bool is_owned(memory_block block) { return is_owned(block.memory_ptr()); };
+
 protected:
 
 	memory_block last_allocated_block{};
 	size_t currently_used_memory = 0;
 	mem_ptr next_ptr = nullptr;
+	// Memory from dirty_end up to end_pointer is known to be zero
+	mem_ptr dirty_end = nullptr;
+
+	memory_resource_manager* segment_source = nullptr;
+	bump_segment_header* last_segment = nullptr;
+	size_t next_segment_size = 0;
+	size_t segments_used_memory = 0;
+	size_t segments_count = 0;
+	mem_ptr initial_dirty_end = nullptr;
+
+	MEM_INLINE mem_ptr get_dirty_end() const { return next_ptr > dirty_end ? next_ptr : dirty_end; };
+	// Segments always come from memory_resource_manager
+	bool has_os_pages() const { return last_segment != nullptr || memory_manager::has_os_pages(); };
+
+	memory_allocation_result allocate_in_new_segment(u32 required_memory_size, u16 alignment, const char* file_name, i32 line);
+	bool is_owned_by_previous_segments(mem_ptr ptr);
+	void release_segments();
 
 public:
 
@@ -225,13 +351,26 @@ bump_memory_manager::bump_memory_manager(memory_resource* resource) : memory_man
 {
 	MEM_ASSERT(resource_info.memory_size() > 16);
 	next_ptr = resource_info.memory_ptr();
+	dirty_end = end_pointer;
+};
+
+bump_memory_manager::bump_memory_manager(memory_resource* resource, memory_resource_manager* segment_source_) : bump_memory_manager(resource)
+{
+	segment_source = segment_source_;
+	next_segment_size = resource_info.memory_size() * 2;
+};
+
+bump_memory_manager::~bump_memory_manager()
+{
+	release_segments();
 };
 
 bump_manager_statistics 
 bump_memory_manager::get_statistics() const
 {
 	bump_manager_statistics stats(assigned_memory_resouce->get_info());
-	stats.memory_used = currently_used_memory;
+	stats.memory_used = currently_used_memory + segments_used_memory;
+	stats.segments_count = segments_count;
 	return stats;
 };
 
@@ -241,6 +380,10 @@ bump_memory_manager::allocate_aligned(u32 required_memory_size, u16 alignment, c
 	if (resource_info.memory_size() < currently_used_memory + required_memory_size)
 	{
 		//DEBUGGER_BREAK();
+		if (segment_source)
+		{
+			return allocate_in_new_segment(required_memory_size, alignment, file_name, line);
+		}
 		return memory_allocation_result{ OUT_OF_MEMORY };
 	}
 
@@ -251,7 +394,11 @@ bump_memory_manager::allocate_aligned(u32 required_memory_size, u16 alignment, c
 
 	if (resource_info.memory_size() < new_possible_memory_used)
 	{
-		DEBUGGER_BREAK();
+		if (segment_source)
+		{
+			return allocate_in_new_segment(required_memory_size, alignment, file_name, line);
+		}
+		//DEBUGGER_BREAK();
 		return memory_allocation_result{ OUT_OF_MEMORY };
 	}
 
@@ -292,6 +439,10 @@ bump_memory_manager::reallocate(memory_block current_memory_block, u32 required_
 	size_t new_possible_memory_used = currently_used_memory + need_more;
 	if (resource_info.memory_size() < new_possible_memory_used)
 	{
+		if (segment_source)
+		{
+			return allocate_in_new_segment(required_memory_size, alignment, file_name, line);
+		}
 		return memory_allocation_result{OUT_OF_MEMORY};
 	}
 
@@ -305,6 +456,7 @@ bump_memory_manager::reallocate(memory_block current_memory_block, u32 required_
 		alignment,
 		memory_allocation_result_types::CONTINUE_CURRENT_BLOCK 
 	};
+	last_allocated_block = result.block;
 	return result;
 }
 
@@ -320,6 +472,7 @@ bump_memory_manager::free(memory_block freed_block, const char* file_name, i32 l
 	if (freed_block == last_allocated_block)
 	{
 		// Alignment size in block size ???
+		dirty_end = get_dirty_end();
 		next_ptr = freed_block.memory_ptr();
 		currently_used_memory -= freed_block.memory_size();
 		last_allocated_block = {};
@@ -334,6 +487,135 @@ bump_memory_manager::free(memory_block freed_block, const char* file_name, i32 l
 void
 bump_memory_manager::return_memory(memory_manager* top_allocator) {};
 
+memory_allocation_result
+bump_memory_manager::allocate_zeroed(u32 required_memory_size, u16 alignment, const char* file_name, i32 line)
+{
+	mem_ptr known_dirty_end = get_dirty_end();
+	memory_allocation_result result = allocate_aligned(required_memory_size, alignment, file_name, line);
+	if (result.result != NEW_BLOCK)
+	{
+		return result;
+	}
+
+	mem_ptr block_ptr = result.block.memory_ptr();
+	if (block_ptr < known_dirty_end)
+	{
+		size_t dirty_size = utils::get_ptr_distance(known_dirty_end, block_ptr);
+		utils::clear_memory(block_ptr, dirty_size < required_memory_size ? dirty_size : required_memory_size, has_os_pages());
+	}
+	return result;
+};
+
+void
+bump_memory_manager::reset(const char* file_name, i32 line)
+{
+	dirty_end = get_dirty_end();
+	release_segments();
+	next_ptr = resource_info.memory_ptr();
+	currently_used_memory = 0;
+	last_allocated_block = {};
+};
+
+void
+bump_memory_manager::clear_and_reset(const char* file_name, i32 line)
+{
+	reset(file_name, line);
+	utils::clear_memory(resource_info.memory_ptr(), utils::get_ptr_distance(dirty_end, resource_info.memory_ptr()), has_os_pages());
+	dirty_end = resource_info.memory_ptr();
+};
+
+memory_allocation_result
+bump_memory_manager::allocate_in_new_segment(u32 required_memory_size, u16 alignment, const char* file_name, i32 line)
+{
+	size_t segment_size = next_segment_size;
+	size_t needed_segment_size = sizeof(bump_segment_header) + required_memory_size + alignment;
+	while (segment_size < needed_segment_size)
+	{
+		segment_size *= 2;
+	}
+
+	memory_resource segment_resource = segment_source->request_memory_from_os(segment_size);
+	memory_block segment_block = segment_resource.get_info();
+	if (segment_block.memory_ptr() == nullptr)
+	{
+		return memory_allocation_result{ OUT_OF_MEMORY };
+	}
+
+	if (last_segment == nullptr)
+	{
+		initial_dirty_end = get_dirty_end();
+	}
+
+	last_segment = new(segment_block.memory_ptr()) bump_segment_header{ last_segment, segment_resource };
+	next_segment_size = segment_block.memory_size() * 2;
+	segments_used_memory += currently_used_memory;
+	++segments_count;
+
+	// OS memory comes zeroed, everything after the header is clean
+	mem_ptr segment_memory_ptr = utils::advance_ptr(segment_block.memory_ptr(), sizeof(bump_segment_header));
+	resource_info = memory_block{ segment_memory_ptr, segment_block.memory_size() - sizeof(bump_segment_header), segment_block.alignment() };
+	end_pointer = utils::advance_ptr(segment_block.memory_ptr(), segment_block.memory_size());
+	next_ptr = segment_memory_ptr;
+	dirty_end = segment_memory_ptr;
+	currently_used_memory = 0;
+	last_allocated_block = {};
+
+	return allocate_aligned(required_memory_size, alignment, file_name, line);
+};
+
+bool
+bump_memory_manager::is_owned_by_previous_segments(mem_ptr ptr)
+{
+	if (last_segment == nullptr)
+	{
+		return false;
+	}
+
+	memory_block initial_block = assigned_memory_resouce->get_info();
+	if (initial_block.memory_ptr() <= ptr && ptr < utils::advance_ptr(initial_block.memory_ptr(), initial_block.memory_size()))
+	{
+		return true;
+	}
+
+	for (bump_segment_header* segment = last_segment->previous_segment; segment != nullptr; segment = segment->previous_segment)
+	{
+		memory_block segment_block = segment->segment_resource.get_info();
+		if (segment_block.memory_ptr() <= ptr && ptr < utils::advance_ptr(segment_block.memory_ptr(), segment_block.memory_size()))
+		{
+			return true;
+		}
+	}
+	return false;
+};
+
+void
+bump_memory_manager::release_segments()
+{
+	if (last_segment == nullptr)
+	{
+		return;
+	}
+
+	// Next time one segment of the biggest size so far should be enough
+	next_segment_size = last_segment->segment_resource.get_info().memory_size();
+	while (last_segment != nullptr)
+	{
+		bump_segment_header* previous_segment = last_segment->previous_segment;
+		memory_resource segment_resource = last_segment->segment_resource;
+		segment_source->return_memory_to_os(segment_resource);
+		last_segment = previous_segment;
+	}
+
+	resource_info = assigned_memory_resouce->get_info();
+	end_pointer = utils::advance_ptr(resource_info.memory_ptr(), resource_info.memory_size());
+	next_ptr = resource_info.memory_ptr();
+	dirty_end = initial_dirty_end;
+	currently_used_memory = 0;
+	segments_used_memory = 0;
+	segments_count = 0;
+	last_allocated_block = {};
+};
+
 
 struct dap_stack_manager_block_header_t;
 
@@ -371,27 +653,86 @@ public:
 	void free(memory_block free_block, const char* file_name, i32 line) override;
 	void return_memory(memory_manager* top_allocator) override;
 
+	// Clears only the part of the block that was used since the last clear_and_reset
+	[[nodiscard]]
+	memory_allocation_result allocate_zeroed(u32 required_memory_size, u16 alignment, const char* file_name, i32 line);
+
+	void reset(const char* file_name, i32 line);
+	void clear_and_reset(const char* file_name, i32 line);
+
 protected:
 
 	dap_stack_manager_block_header_t* last_allocated_control_block = nullptr;
 	dap_stack_manager_block_header_t* next_control_block = nullptr;
 	size_t currently_used_memory = 0;
+	// Memory from dirty_end up to end_pointer is known to be zero
+	mem_ptr dirty_end = nullptr;
 
 	[[nodiscard]] u16 place_next_control_block(mem_ptr from);
+	mem_ptr get_dirty_end() const;
 };
 
 stack_memory_manager::stack_memory_manager(memory_resource* resource) : memory_manager(resource)
 {
 	MEM_ASSERT(resource_info.memory_size() > 16);
+	dirty_end = end_pointer;
+	reset(ACI);
+};
+
+void
+stack_memory_manager::reset(const char* file_name, i32 line)
+{
+	dirty_end = get_dirty_end();
+
 	size_t needed_more_for_align = utils::get_aligned_distance(resource_info.memory_ptr(), default_alignment);
 	mem_ptr next_aligned = utils::advance_ptr(resource_info.memory_ptr(), needed_more_for_align);
 
 	next_control_block = (dap_stack_manager_block_header_t*)next_aligned;
 	*next_control_block = {};
+	last_allocated_control_block = nullptr;
 
 	currently_used_memory = needed_more_for_align;
 };
 
+void
+stack_memory_manager::clear_and_reset(const char* file_name, i32 line)
+{
+	utils::clear_memory(resource_info.memory_ptr(), utils::get_ptr_distance(get_dirty_end(), resource_info.memory_ptr()), has_os_pages());
+	reset(file_name, line);
+	dirty_end = resource_info.memory_ptr();
+};
+
+memory_allocation_result
+stack_memory_manager::allocate_zeroed(u32 required_memory_size, u16 alignment, const char* file_name, i32 line)
+{
+	mem_ptr known_dirty_end = get_dirty_end();
+	memory_allocation_result result = allocate_aligned(required_memory_size, alignment, file_name, line);
+	if (result.result != NEW_BLOCK)
+	{
+		return result;
+	}
+
+	mem_ptr block_ptr = result.block.memory_ptr();
+	if (block_ptr < known_dirty_end)
+	{
+		size_t dirty_size = utils::get_ptr_distance(known_dirty_end, block_ptr);
+		utils::clear_memory(block_ptr, dirty_size < required_memory_size ? dirty_size : required_memory_size, has_os_pages());
+	}
+	return result;
+};
+
+mem_ptr
+stack_memory_manager::get_dirty_end() const
+{
+	if (next_control_block == nullptr)
+	{
+		return end_pointer;
+	}
+
+	mem_ptr used_end = next_control_block + 1;
+	return used_end > dirty_end ? used_end : dirty_end;
+};
+
 stack_manager_statistics
 stack_memory_manager::get_statistics() const
 {
@@ -406,7 +747,7 @@ stack_memory_manager::allocate_aligned(u32 required_memory_size, u16 alignment,
 {
 	if (next_control_block == nullptr)
 	{
-		DEBUGGER_BREAK();
+		//DEBUGGER_BREAK();
 		return memory_allocation_result{ OUT_OF_MEMORY };
 	}
 
@@ -432,7 +773,7 @@ stack_memory_manager::allocate_aligned(u32 required_memory_size, u16 alignment,
 	size_t new_possible_memory_used = need_to_have + needed_more_for_align;
 	if (resource_info.memory_size() < new_possible_memory_used)
 	{
-		DEBUGGER_BREAK();
+		//DEBUGGER_BREAK();
 		return memory_allocation_result{ OUT_OF_MEMORY };
 	}
 	  
@@ -572,6 +913,7 @@ stack_memory_manager::free(memory_block freed_block, const char* file_name, i32
 	// TODO:: Cleanup required
 	if (is_last_block)
 	{
+		dirty_end = get_dirty_end();
 		MEM_ASSERT(currently_used_memory > freed_block_header->block_size);
 		currently_used_memory -= freed_block_header->block_size;
 		last_allocated_control_block = freed_block_header->previous_block;
@@ -647,18 +989,6 @@ protected:
 	[[nodiscard]] u16 place_next_control_block(mem_ptr from);
 };
 
-//void stack_allocator::restart(const char* file_name, i32 line)
-//{
-//	currently_used_memory = 0;
-//	next_free_memory_ptr = initial_memory_ptr;
-//}
-//
-//void stack_allocator::clear_and_restart(const char* file_name, i32 line)
-//{
-//	memset((u8*)initial_memory_ptr, 0x00, currently_used_memory);
-//	restart(file_name, line);
-//}
-
 //class general_memory_manager : public memory_manager
 //{
 //
@@ -130,10 +130,14 @@ public:
 		return memory_block_info;
 	}
 
+	memory_resource_growth_type get_growth_type() const { return growth_type; };
+
 	void bind_to_manager(memory_manager* manager) { assigned_memory_manager = manager; };
 
 protected:
 
+	friend class memory_resource_manager;
+
 	memory_block memory_block_info{};
 	memory_manager* creator_memory_manager = nullptr;
 	memory_manager* assigned_memory_manager = nullptr;
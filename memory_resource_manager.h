@@ -2,6 +2,12 @@
 
 //#import "memory_resource.h"
 
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
 namespace dap
 {
 
@@ -13,20 +19,78 @@ class memory_resource_manager
 
 public:
 
+	// Memory is committed upfront and comes zeroed from the OS, size is rounded up to os_page_size.
+	// Returns an empty resource when the OS refuses.
 	[[nodiscard]]
-	memory_resource request_memory_from_os() { return memory_resource{}; };
+	memory_resource request_memory_from_os(size_t memory_size);
+
+	void return_memory_to_os(memory_resource& resource);
 
-	void return_memory_to_os() {};
+	// Gives pages of memory from request_memory_from_os back, they read back as zero.
+	// ptr and memory_size must be multiples of os_page_size.
+	static bool discard_pages(mem_ptr memory_ptr, size_t memory_size);
 
 	void change_protection() {};
 
 	void grow_memory() {};
 
+	static inline constexpr u16 os_page_size = 4096;
+
 protected:
 
 	
 };
 
+memory_resource
+memory_resource_manager::request_memory_from_os(size_t memory_size)
+{
+	memory_size = (memory_size + os_page_size - 1) & ~static_cast<size_t>(os_page_size - 1);
+
+#if defined(_WIN32)
+	mem_ptr memory_ptr = VirtualAlloc(nullptr, memory_size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	mem_ptr memory_ptr = mmap(nullptr, memory_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	memory_ptr = memory_ptr == MAP_FAILED ? nullptr : memory_ptr;
+#endif
+
+	if (memory_ptr == nullptr)
+	{
+		return memory_resource{};
+	}
+
+	memory_resource resource{ memory_ptr, memory_size, os_page_size };
+	resource.growth_type = memory_resource_growth_type::COMMIT_ALL;
+	return resource;
+};
+
+void
+memory_resource_manager::return_memory_to_os(memory_resource& resource)
+{
+	memory_block resource_block = resource.get_info();
+	if (resource_block.memory_ptr() == nullptr)
+	{
+		return;
+	}
+
+#if defined(_WIN32)
+	VirtualFree(resource_block.memory_ptr(), 0, MEM_RELEASE);
+#else
+	munmap(resource_block.memory_ptr(), resource_block.memory_size());
+#endif
+
+	resource = memory_resource{};
+};
+
+bool
+memory_resource_manager::discard_pages(mem_ptr memory_ptr, size_t memory_size)
+{
+#if defined(_WIN32)
+	return VirtualFree(memory_ptr, memory_size, MEM_DECOMMIT) && VirtualAlloc(memory_ptr, memory_size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+	return madvise(memory_ptr, memory_size, MADV_DONTNEED) == 0;
+#endif
+};
+
 }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,465 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace dap
+{
+
+namespace memory
+{
+
+// Trace file layout: memory_trace_file_header followed by memory_trace_record entries.
+// CALL_SITE records are written the first time a file/line pair is seen, the size field holds the line,
+// the alignment field holds the length of the file name, which follows the record.
+
+enum class memory_trace_event_type : u8
+{
+	CALL_SITE = 0,
+	ALLOCATE,
+	REALLOCATE,
+	FREE
+};
+
+#pragma pack(push, 1)
+
+struct memory_trace_file_header
+{
+	u32 magic = file_magic;
+	u32 version = file_version;
+
+	static inline constexpr u32 file_magic = 0x54504144; // DAPT
+	static inline constexpr u32 file_version = 1;
+};
+
+struct memory_trace_record
+{
+	memory_trace_event_type type = memory_trace_event_type::CALL_SITE;
+	u8 result = 0;
+	u16 alignment = 0;
+	u32 size = 0;
+	u32 call_site = 0;
+	u32 thread_id = 0;
+	u64 timestamp = 0;
+	u64 block_id = 0;
+	u64 previous_block_id = 0;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(memory_trace_record) == 40);
+
+struct memory_trace_call_site
+{
+	std::string file_name;
+	i32 line = 0;
+};
+
+struct memory_trace
+{
+	std::vector<memory_trace_call_site> call_sites;
+	std::vector<memory_trace_record> events;
+};
+
+class memory_trace_writer
+{
+
+public:
+
+	explicit memory_trace_writer(FILE* output_);
+	~memory_trace_writer() { flush(); };
+
+	memory_trace_writer(memory_trace_writer&) = delete;
+	memory_trace_writer& operator=(const memory_trace_writer&) = delete;
+
+	void write_event(memory_trace_record record, const char* file_name, i32 line);
+	void flush();
+
+protected:
+
+	struct call_site_key
+	{
+		const char* file_name;
+		i32 line;
+
+		bool operator==(const call_site_key& other) const { return file_name == other.file_name && line == other.line; };
+	};
+
+	struct call_site_key_hash
+	{
+		size_t operator()(const call_site_key& key) const
+		{
+			return std::hash<const char*>{}(key.file_name) ^ (static_cast<size_t>(key.line) * 0x9E3779B97F4A7C15ull);
+		};
+	};
+
+	static inline constexpr size_t buffer_size = 64 * 1024;
+
+	u32 get_call_site_id(const char* file_name, i32 line);
+	void write_bytes(const void* data, size_t size);
+
+	FILE* output = nullptr;
+	std::chrono::steady_clock::time_point start_time;
+	std::unordered_map<call_site_key, u32, call_site_key_hash> call_sites;
+	size_t buffer_used = 0;
+	u8 buffer[buffer_size];
+};
+
+memory_trace_writer::memory_trace_writer(FILE* output_) : output(output_), start_time(std::chrono::steady_clock::now())
+{
+	memory_trace_file_header header{};
+	write_bytes(&header, sizeof(header));
+};
+
+void
+memory_trace_writer::write_event(memory_trace_record record, const char* file_name, i32 line)
+{
+	thread_local u32 thread_id = static_cast<u32>(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+	record.call_site = get_call_site_id(file_name, line);
+	record.thread_id = thread_id;
+	record.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count();
+	write_bytes(&record, sizeof(record));
+};
+
+u32
+memory_trace_writer::get_call_site_id(const char* file_name, i32 line)
+{
+	auto [it, inserted] = call_sites.try_emplace(call_site_key{ file_name, line }, static_cast<u32>(call_sites.size()));
+	if (inserted)
+	{
+		size_t name_length = file_name ? strlen(file_name) : 0;
+		name_length = name_length > 0xFFFF ? 0xFFFF : name_length;
+
+		memory_trace_record call_site_record{};
+		call_site_record.type = memory_trace_event_type::CALL_SITE;
+		call_site_record.call_site = it->second;
+		call_site_record.size = static_cast<u32>(line);
+		call_site_record.alignment = static_cast<u16>(name_length);
+		write_bytes(&call_site_record, sizeof(call_site_record));
+		if (name_length > 0)
+		{
+			write_bytes(file_name, name_length);
+		}
+	}
+	return it->second;
+};
+
+void
+memory_trace_writer::write_bytes(const void* data, size_t size)
+{
+	if (buffer_used + size > buffer_size)
+	{
+		flush();
+	}
+
+	if (size > buffer_size)
+	{
+		fwrite(data, 1, size, output);
+		return;
+	}
+
+	memcpy(buffer + buffer_used, data, size);
+	buffer_used += size;
+};
+
+void
+memory_trace_writer::flush()
+{
+	if (buffer_used > 0)
+	{
+		fwrite(buffer, 1, buffer_used, output);
+		buffer_used = 0;
+	}
+	fflush(output);
+};
+
+[[nodiscard]]
+bool
+read_memory_trace(FILE* input, memory_trace& trace)
+{
+	memory_trace_file_header header{};
+	if (fread(&header, sizeof(header), 1, input) != 1 ||
+		header.magic != memory_trace_file_header::file_magic ||
+		header.version != memory_trace_file_header::file_version)
+	{
+		return false;
+	}
+
+	memory_trace_record record{};
+	for (;;)
+	{
+		size_t read_size = fread(&record, 1, sizeof(record), input);
+		if (read_size == 0)
+		{
+			return feof(input) != 0;
+		}
+
+		// Truncated last record or a type this version does not know
+		if (read_size != sizeof(record) || record.type > memory_trace_event_type::FREE)
+		{
+			return false;
+		}
+
+		if (record.type != memory_trace_event_type::CALL_SITE)
+		{
+			// Call sites are written before the first event that uses them
+			if (record.call_site >= trace.call_sites.size())
+			{
+				return false;
+			}
+			trace.events.push_back(record);
+			continue;
+		}
+
+		// Ids are handed out in the order the call sites are written
+		if (record.call_site != trace.call_sites.size())
+		{
+			return false;
+		}
+
+		memory_trace_call_site call_site{};
+		call_site.line = static_cast<i32>(record.size);
+		call_site.file_name.resize(record.alignment);
+		if (record.alignment > 0 && fread(call_site.file_name.data(), record.alignment, 1, input) != 1)
+		{
+			return false;
+		}
+
+		trace.call_sites.push_back(std::move(call_site));
+	}
+};
+
+// Records every call into the trace and forwards it to Manager.
+// memory_trace_writer is not thread-safe, threads recording at the same time need a writer each or a lock around the manager.
+// The thread id in the records tells apart threads that use the manager one after another.
+template<typename Manager>
+class trace_recording_memory_manager : public memory_manager
+{
+
+public:
+
+	trace_recording_memory_manager(Manager& manager_, memory_trace_writer& writer_) : manager(manager_), writer(writer_) {};
+
+	memory_allocation_result allocate_aligned(u32 required_memory_size, u16 alignment, const char* file_name, i32 line) override;
+	memory_allocation_result reallocate(memory_block block, u32 required_memory_size, const char* file_name, i32 line) override;
+	void free(memory_block free_block, const char* file_name, i32 line) override;
+	void return_memory(memory_manager* top_allocator) override { manager.Manager::return_memory(top_allocator); };
+
+	bool is_owned(mem_ptr ptr) { return manager.Manager::is_owned(ptr); };
+	bool is_owned(memory_block block) { return is_owned(block.memory_ptr()); };
+
+protected:
+
+	Manager& manager;
+	memory_trace_writer& writer;
+};
+
+template<typename Manager>
+memory_allocation_result
+trace_recording_memory_manager<Manager>::allocate_aligned(u32 required_memory_size, u16 alignment, const char* file_name, i32 line)
+{
+	memory_allocation_result result = manager.Manager::allocate_aligned(required_memory_size, alignment, file_name, line);
+
+	memory_trace_record record{};
+	record.type = memory_trace_event_type::ALLOCATE;
+	record.result = static_cast<u8>(result.result);
+	record.alignment = alignment;
+	record.size = required_memory_size;
+	record.block_id = reinterpret_cast<size_t>(result.block.memory_ptr());
+	writer.write_event(record, file_name, line);
+
+	return result;
+};
+
+template<typename Manager>
+memory_allocation_result
+trace_recording_memory_manager<Manager>::reallocate(memory_block block, u32 required_memory_size, const char* file_name, i32 line)
+{
+	memory_allocation_result result = manager.Manager::reallocate(block, required_memory_size, file_name, line);
+
+	memory_trace_record record{};
+	record.type = memory_trace_event_type::REALLOCATE;
+	record.result = static_cast<u8>(result.result);
+	record.alignment = block.alignment();
+	record.size = required_memory_size;
+	record.block_id = reinterpret_cast<size_t>(result.block.memory_ptr());
+	record.previous_block_id = reinterpret_cast<size_t>(block.memory_ptr());
+	writer.write_event(record, file_name, line);
+
+	return result;
+};
+
+template<typename Manager>
+void
+trace_recording_memory_manager<Manager>::free(memory_block freed_block, const char* file_name, i32 line)
+{
+	manager.Manager::free(freed_block, file_name, line);
+
+	memory_trace_record record{};
+	record.type = memory_trace_event_type::FREE;
+	record.alignment = freed_block.alignment();
+	record.size = static_cast<u32>(freed_block.memory_size());
+	record.block_id = reinterpret_cast<size_t>(freed_block.memory_ptr());
+	writer.write_event(record, file_name, line);
+};
+
+
+struct memory_trace_replay_statistics
+{
+	u64 replayed_events = 0;
+	u64 failed_events = 0;
+	u64 elapsed_nanoseconds = 0;
+	size_t peak_memory_used = 0;
+	// Distance between the lowest and highest address handed out, meaningful for managers over a single resource
+	size_t peak_memory_footprint = 0;
+	// 1 - peak_memory_used / peak_memory_footprint
+	double fragmentation = 0.0;
+};
+
+// Drives manager with the events of the trace, only the events that succeeded while recording are replayed.
+// Block addresses are resolved to slots before the timed part, so the elapsed time is spent almost entirely in the manager.
+memory_trace_replay_statistics
+replay_memory_trace(memory_manager& manager, const memory_trace& trace)
+{
+	struct replay_event
+	{
+		memory_trace_event_type type;
+		u16 alignment;
+		u32 size;
+		u32 slot;
+		u32 previous_slot;
+	};
+
+	constexpr u32 no_slot = ~0u;
+
+	std::vector<replay_event> replay_events;
+	replay_events.reserve(trace.events.size());
+	std::unordered_map<u64, u32> live_slots;
+	u32 slot_count = 0;
+
+	for (const memory_trace_record& record : trace.events)
+	{
+		bool succeeded = record.result == NEW_BLOCK || record.result == CONTINUE_CURRENT_BLOCK || record.result == CURRENT_BLOCK_BIG_ENOUGH;
+		replay_event event{ record.type, record.alignment, record.size, no_slot, no_slot };
+
+		if (record.type == memory_trace_event_type::ALLOCATE)
+		{
+			if (!succeeded)
+			{
+				continue;
+			}
+			event.slot = slot_count++;
+			live_slots[record.block_id] = event.slot;
+		}
+		else if (record.type == memory_trace_event_type::REALLOCATE)
+		{
+			auto previous = live_slots.find(record.previous_block_id);
+			if (!succeeded || previous == live_slots.end())
+			{
+				continue;
+			}
+			event.previous_slot = previous->second;
+			live_slots.erase(previous);
+			event.slot = slot_count++;
+			live_slots[record.block_id] = event.slot;
+		}
+		else if (record.type == memory_trace_event_type::FREE)
+		{
+			auto freed = live_slots.find(record.block_id);
+			if (freed == live_slots.end())
+			{
+				continue;
+			}
+			event.slot = freed->second;
+			live_slots.erase(freed);
+		}
+		else
+		{
+			continue;
+		}
+		replay_events.push_back(event);
+	}
+
+	memory_trace_replay_statistics stats{};
+	std::vector<memory_block> blocks(slot_count);
+	size_t memory_used = 0;
+	mem_ptr lowest_ptr = nullptr;
+	mem_ptr highest_ptr = nullptr;
+
+	auto track_new_block = [&](const memory_block& block)
+	{
+		memory_used += block.memory_size();
+		stats.peak_memory_used = memory_used > stats.peak_memory_used ? memory_used : stats.peak_memory_used;
+
+		mem_ptr block_end = utils::advance_ptr(block.memory_ptr(), block.memory_size());
+		lowest_ptr = (lowest_ptr == nullptr || block.memory_ptr() < lowest_ptr) ? block.memory_ptr() : lowest_ptr;
+		highest_ptr = block_end > highest_ptr ? block_end : highest_ptr;
+	};
+
+	std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+	for (const replay_event& event : replay_events)
+	{
+		++stats.replayed_events;
+		if (event.type == memory_trace_event_type::ALLOCATE)
+		{
+			memory_allocation_result result = manager.allocate_aligned(event.size, event.alignment, ACI);
+			if (result.result != NEW_BLOCK)
+			{
+				++stats.failed_events;
+				continue;
+			}
+			blocks[event.slot] = result.block;
+			track_new_block(result.block);
+		}
+		else if (event.type == memory_trace_event_type::REALLOCATE)
+		{
+			memory_block previous_block = blocks[event.previous_slot];
+			if (previous_block.memory_ptr() == nullptr)
+			{
+				++stats.failed_events;
+				continue;
+			}
+
+			memory_allocation_result result = manager.reallocate(previous_block, event.size, ACI);
+			if (result.result != NEW_BLOCK && result.result != CONTINUE_CURRENT_BLOCK && result.result != CURRENT_BLOCK_BIG_ENOUGH)
+			{
+				++stats.failed_events;
+				continue;
+			}
+			memory_used -= previous_block.memory_size();
+			blocks[event.previous_slot] = {};
+			blocks[event.slot] = result.block;
+			track_new_block(result.block);
+		}
+		else
+		{
+			memory_block freed_block = blocks[event.slot];
+			if (freed_block.memory_ptr() == nullptr)
+			{
+				++stats.failed_events;
+				continue;
+			}
+			manager.free(freed_block, ACI);
+			memory_used -= freed_block.memory_size();
+			blocks[event.slot] = {};
+		}
+	}
+
+	stats.elapsed_nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count();
+	stats.peak_memory_footprint = lowest_ptr ? static_cast<size_t>(utils::get_ptr_distance(highest_ptr, lowest_ptr)) : 0;
+	if (stats.peak_memory_footprint > 0)
+	{
+		stats.fragmentation = 1.0 - static_cast<double>(stats.peak_memory_used) / static_cast<double>(stats.peak_memory_footprint);
+	}
+	return stats;
+};
+
+}
+
+}
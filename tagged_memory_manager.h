@@ -0,0 +1,293 @@
+#pragma once
+
+namespace dap
+{
+
+namespace memory
+{
+
+typedef u8 memory_tag;
+
+struct tagged_manager_statistics : memory_manager_statistics
+{
+	using memory_manager_statistics::memory_manager_statistics;
+
+	size_t pages_used = 0;
+	size_t pages_count = 0;
+};
+
+struct memory_tag_statistics
+{
+	size_t memory_used = 0;
+	size_t memory_budget = 0;
+	size_t pages_used = 0;
+};
+
+struct tagged_page_header
+{
+	tagged_page_header* next_page = nullptr;
+	u32 used_memory = 0;
+	memory_tag tag = 0;
+};
+
+// Resource is split into pages of page_size, every page belongs to a single tag and blocks are bumped inside of it.
+// Budgets are charged in whole pages when a tag takes a page, so alignment padding and partly used pages count too.
+// A budget below page_size lets the tag take no page at all. free_all gives all pages of a tag back in O(pages).
+// Single free gives memory back only for the last block of the tag, blocks bigger than a page are not supported.
+// Plain allocate_aligned uses default_tag.
+class tagged_memory_manager : public memory_manager
+{
+
+public:
+
+	static inline constexpr u32 tags_count = 256;
+	static inline constexpr memory_tag default_tag = 0;
+	static inline constexpr u32 default_page_size = 64 * 1024;
+
+	explicit tagged_memory_manager(memory_resource* resource, u32 page_size_ = default_page_size);
+
+	memory_allocation_result allocate_aligned(u32 required_memory_size, u16 alignment, const char* file_name, i32 line) override;
+	memory_allocation_result reallocate(memory_block block, u32 required_memory_size, const char* file_name, i32 line) override;
+	void free(memory_block free_block, const char* file_name, i32 line) override;
+	void return_memory(memory_manager* top_allocator) override;
+
+	[[nodiscard]]
+	memory_allocation_result allocate_tagged(u32 required_memory_size, u16 alignment, memory_tag tag, const char* file_name, i32 line);
+
+	void free_all(memory_tag tag, const char* file_name, i32 line);
+
+	void set_budget(memory_tag tag, size_t memory_budget) { tags[tag].memory_budget = memory_budget; };
+
+	memory_tag get_tag(memory_block block) const { return get_page(block.memory_ptr())->tag; };
+
+	tagged_manager_statistics get_statistics() const;
+	memory_tag_statistics get_tag_statistics(memory_tag tag) const;
+
+protected:
+
+	struct tag_state
+	{
+		tagged_page_header* current_page = nullptr;
+		memory_block last_allocated_block{};
+		size_t memory_used = 0;
+		size_t memory_budget = ~size_t(0);
+		size_t pages_used = 0;
+	};
+
+	static inline constexpr u32 page_header_size = (sizeof(tagged_page_header) + default_alignment - 1) & ~(default_alignment - 1);
+
+	tagged_page_header* get_page(mem_ptr ptr) const
+	{
+		size_t page_index = utils::get_ptr_distance(ptr, pages_begin) / page_size;
+		return utils::advance_ptr<tagged_page_header*>(pages_begin, page_index * page_size);
+	};
+
+	tagged_page_header* take_page(memory_tag tag);
+
+	tag_state tags[tags_count];
+	tagged_page_header* free_pages = nullptr;
+	mem_ptr pages_begin = nullptr;
+	mem_ptr untouched_pages_begin = nullptr;
+	size_t pages_count = 0;
+	size_t pages_used = 0;
+	u32 page_size = 0;
+};
+
+tagged_memory_manager::tagged_memory_manager(memory_resource* resource, u32 page_size_) :
+	memory_manager(resource),
+	page_size(page_size_)
+{
+	MEM_ASSERT(page_size > page_header_size && page_size % default_alignment == 0);
+	pages_begin = utils::advance_ptr(resource_info.memory_ptr(), utils::get_aligned_distance(resource_info.memory_ptr(), default_alignment));
+	pages_count = utils::get_ptr_distance(end_pointer, pages_begin) / page_size;
+	untouched_pages_begin = pages_begin;
+};
+
+tagged_manager_statistics
+tagged_memory_manager::get_statistics() const
+{
+	tagged_manager_statistics stats(assigned_memory_resouce->get_info());
+	for (u32 i = 0; i < tags_count; ++i)
+	{
+		stats.memory_used += tags[i].memory_used;
+	}
+	stats.pages_used = pages_used;
+	stats.pages_count = pages_count;
+	return stats;
+};
+
+memory_tag_statistics
+tagged_memory_manager::get_tag_statistics(memory_tag tag) const
+{
+	memory_tag_statistics stats{};
+	stats.memory_used = tags[tag].memory_used;
+	stats.memory_budget = tags[tag].memory_budget;
+	stats.pages_used = tags[tag].pages_used;
+	return stats;
+};
+
+tagged_page_header*
+tagged_memory_manager::take_page(memory_tag tag)
+{
+	tag_state& state = tags[tag];
+	if ((state.pages_used + 1) * page_size > state.memory_budget)
+	{
+		return nullptr;
+	}
+
+	tagged_page_header* page = free_pages;
+	if (page != nullptr)
+	{
+		free_pages = page->next_page;
+	}
+	else if (utils::get_ptr_distance(untouched_pages_begin, pages_begin) < static_cast<i64>(pages_count * page_size))
+	{
+		page = static_cast<tagged_page_header*>(untouched_pages_begin);
+		untouched_pages_begin = utils::advance_ptr(untouched_pages_begin, page_size);
+	}
+	else
+	{
+		return nullptr;
+	}
+
+	page = new(page) tagged_page_header{ state.current_page, page_header_size, tag };
+	state.current_page = page;
+	++state.pages_used;
+	++pages_used;
+	return page;
+};
+
+memory_allocation_result
+tagged_memory_manager::allocate_tagged(u32 required_memory_size, u16 alignment, memory_tag tag, const char* file_name, i32 line)
+{
+	tag_state& state = tags[tag];
+	tagged_page_header* page = state.current_page;
+	u32 needed_more_for_align = 0;
+	for (i32 attempt = 0; attempt < 2; ++attempt)
+	{
+		if (page != nullptr)
+		{
+			mem_ptr next_ptr = utils::advance_ptr(page, page->used_memory);
+			needed_more_for_align = utils::get_aligned_distance(next_ptr, alignment);
+			if (static_cast<size_t>(page->used_memory) + needed_more_for_align + required_memory_size <= page_size)
+			{
+				break;
+			}
+		}
+
+		if (attempt > 0 || static_cast<size_t>(page_header_size) + alignment + required_memory_size > page_size)
+		{
+			return memory_allocation_result{ OUT_OF_MEMORY };
+		}
+
+		page = take_page(tag);
+		if (page == nullptr)
+		{
+			return memory_allocation_result{ OUT_OF_MEMORY };
+		}
+	}
+
+	mem_ptr block_ptr = utils::advance_ptr(page, page->used_memory + needed_more_for_align);
+	page->used_memory += needed_more_for_align + required_memory_size;
+	state.memory_used += required_memory_size;
+
+	memory_allocation_result result{ block_ptr, required_memory_size, alignment, NEW_BLOCK };
+	state.last_allocated_block = result.block;
+
+	if (MEM_IS_DEFINED(_DEBUG_LOG_ALLOCATIONS))
+	{}
+
+	return result;
+};
+
+memory_allocation_result
+tagged_memory_manager::allocate_aligned(u32 required_memory_size, u16 alignment, const char* file_name, i32 line)
+{
+	return allocate_tagged(required_memory_size, alignment, default_tag, file_name, line);
+};
+
+memory_allocation_result
+tagged_memory_manager::reallocate(memory_block block, u32 required_memory_size, const char* file_name, i32 line)
+{
+	if (!is_owned(block))
+	{
+		DEBUGGER_BREAK();
+		return memory_allocation_result{ WRONG_MANAGER };
+	}
+
+	if (block.memory_size() >= required_memory_size)
+	{
+		return memory_allocation_result{ block, CURRENT_BLOCK_BIG_ENOUGH };
+	}
+
+	tagged_page_header* page = get_page(block.memory_ptr());
+	tag_state& state = tags[page->tag];
+	if (state.last_allocated_block != block)
+	{
+		return allocate_tagged(required_memory_size, block.alignment(), page->tag, file_name, line);
+	}
+
+	size_t need_more = required_memory_size - block.memory_size();
+	if (page->used_memory + need_more > page_size)
+	{
+		return allocate_tagged(required_memory_size, block.alignment(), page->tag, file_name, line);
+	}
+
+	page->used_memory += static_cast<u32>(need_more);
+	state.memory_used += need_more;
+
+	memory_allocation_result result{ block.memory_ptr(), required_memory_size, block.alignment(), CONTINUE_CURRENT_BLOCK };
+	state.last_allocated_block = result.block;
+	return result;
+};
+
+void
+tagged_memory_manager::free(memory_block freed_block, const char* file_name, i32 line)
+{
+	if (!is_owned(freed_block))
+	{
+		DEBUGGER_BREAK();
+		return;
+	}
+
+	tagged_page_header* page = get_page(freed_block.memory_ptr());
+	tag_state& state = tags[page->tag];
+	if (state.last_allocated_block == freed_block)
+	{
+		page->used_memory = static_cast<u32>(utils::get_ptr_distance(freed_block.memory_ptr(), page));
+		state.memory_used -= freed_block.memory_size();
+		state.last_allocated_block = {};
+	}
+
+	if (MEM_IS_DEFINED(_DEBUG_LOG_ALLOCATIONS))
+	{
+		//LOG free
+	}
+};
+
+void
+tagged_memory_manager::free_all(memory_tag tag, const char* file_name, i32 line)
+{
+	tag_state& state = tags[tag];
+	tagged_page_header* page = state.current_page;
+	while (page != nullptr)
+	{
+		tagged_page_header* next_page = page->next_page;
+		page->next_page = free_pages;
+		free_pages = page;
+		page = next_page;
+	}
+
+	pages_used -= state.pages_used;
+	state.current_page = nullptr;
+	state.last_allocated_block = {};
+	state.memory_used = 0;
+	state.pages_used = 0;
+};
+
+void
+tagged_memory_manager::return_memory(memory_manager* top_allocator) {};
+
+}
+
+}
@@ -0,0 +1,60 @@
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#include "memory_resource.h"
+#include "memory_resource_manager.h"
+#include "memory_manager.h"
+
+using namespace dap::memory;
+
+static int failed_checks = 0;
+
+#define CHECK(condition) if (!(condition)) { printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #condition); ++failed_checks; }
+
+// The last block keeps growing in place and can be freed after it grew
+static void grow_last_block(bump_memory_manager& manager)
+{
+	memory_allocation_result first = manager.allocate(100, ACI);
+	CHECK(first.result == NEW_BLOCK);
+	size_t used_memory = manager.get_statistics().memory_used;
+
+	memory_block block = first.block;
+	for (u32 size = 200; size <= 1000; size += 100)
+	{
+		memory_allocation_result result = manager.reallocate(block, size, ACI);
+		CHECK(result.result == CONTINUE_CURRENT_BLOCK);
+		CHECK(result.block.memory_ptr() == first.block.memory_ptr());
+		block = result.block;
+	}
+	CHECK(manager.get_statistics().memory_used == used_memory + 900);
+
+	manager.free(block, ACI);
+	CHECK(manager.get_statistics().memory_used == used_memory - 100);
+}
+
+static void grow_in_place()
+{
+	fixed_memory_resource<4096> resource;
+	bump_memory_manager manager(&resource);
+	grow_last_block(manager);
+}
+
+static void grow_in_place_in_segment()
+{
+	memory_resource_manager segment_source;
+	fixed_memory_resource<256> resource;
+	bump_memory_manager manager(&resource, &segment_source);
+
+	memory_allocation_result filler = manager.allocate(200, ACI);
+	CHECK(filler.result == NEW_BLOCK);
+	grow_last_block(manager);
+	CHECK(manager.get_statistics().segments_count == 1);
+}
+
+int main()
+{
+	grow_in_place();
+	grow_in_place_in_segment();
+	return failed_checks == 0 ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#include "memory_resource.h"
+#include "memory_resource_manager.h"
+#include "memory_manager.h"
+#include "compacting_memory_manager.h"
+
+using namespace dap::memory;
+
+static int failed_checks = 0;
+
+#define CHECK(condition) if (!(condition)) { printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #condition); ++failed_checks; }
+
+// Blocks below a pinned block at the top have to be usable again
+static void pinned_block_at_top()
+{
+	fixed_memory_resource<64 * 1024> resource;
+	compacting_memory_manager manager(&resource, 64);
+
+	memory_handle handles[64];
+	u32 handles_count = 0;
+	for (; handles_count < 64; ++handles_count)
+	{
+		handles[handles_count] = manager.allocate_handle(1000, ACI);
+		if (!handles[handles_count].is_valid())
+		{
+			break;
+		}
+		memset(manager.resolve(handles[handles_count]), static_cast<int>(handles_count), 1000);
+	}
+	CHECK(handles_count > 2);
+
+	memory_handle pinned = handles[handles_count - 1];
+	manager.pin(pinned);
+	for (u32 i = 0; i + 1 < handles_count; ++i)
+	{
+		manager.free_handle(handles[i], ACI);
+	}
+
+	for (u32 i = 0; i + 1 < handles_count; ++i)
+	{
+		handles[i] = manager.allocate_handle(1000, ACI);
+		CHECK(handles[i].is_valid());
+	}
+	CHECK(manager.get_statistics().live_memory == handles_count * 1024);
+
+	u8* pinned_memory = static_cast<u8*>(manager.resolve(pinned));
+	CHECK(pinned_memory[0] == handles_count - 1 && pinned_memory[999] == handles_count - 1);
+	manager.unpin(pinned);
+}
+
+// Blocks of the plain interface stay apart from handle blocks
+static void plain_block_does_not_block_compaction()
+{
+	fixed_memory_resource<64 * 1024> resource;
+	compacting_memory_manager manager(&resource, 64);
+
+	memory_handle first = manager.allocate_handle(16 * 1024, ACI);
+	memory_allocation_result plain = manager.allocate(1000, ACI);
+	memory_handle second = manager.allocate_handle(16 * 1024, ACI);
+	CHECK(first.is_valid() && plain.result == NEW_BLOCK && second.is_valid());
+
+	manager.free_handle(first, ACI);
+	memory_handle big = manager.allocate_handle(40 * 1024, ACI);
+	CHECK(big.is_valid());
+
+	manager.free(plain.block, ACI);
+	CHECK(manager.get_statistics().live_memory == 16 * 1024 + 16 + 40 * 1024 + 16);
+}
+
+// One call stops after the visited blocks budget even when nothing is moved
+static void compaction_visits_bounded_blocks()
+{
+	fixed_memory_resource<64 * 1024> resource;
+	compacting_memory_manager manager(&resource, 128);
+
+	memory_handle handles[100];
+	for (u32 i = 0; i < 100; ++i)
+	{
+		handles[i] = manager.allocate_handle(100, ACI);
+	}
+	for (u32 i = 0; i < 99; ++i)
+	{
+		manager.free_handle(handles[i], ACI);
+	}
+
+	CHECK(manager.compact(~size_t(0), 10) == 0);
+	CHECK(manager.get_statistics().compaction_in_progress);
+	manager.compact(~size_t(0), ~size_t(0));
+	CHECK(!manager.get_statistics().compaction_in_progress);
+	CHECK(manager.get_statistics().memory_used == 128);
+}
+
+int main()
+{
+	pinned_block_at_top();
+	plain_block_does_not_block_compaction();
+	compaction_visits_bounded_blocks();
+	return failed_checks == 0 ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <unordered_map>
+
+#include "memory_resource.h"
+#include "memory_resource_manager.h"
+#include "memory_manager.h"
+#include "flat_hash_map.h"
+
+using namespace dap::memory;
+
+static int failed_checks = 0;
+
+#define CHECK(condition) if (!(condition)) { printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #condition); ++failed_checks; }
+
+// Few distinct hashes, so probe sequences collide and rehashing has to swap entries
+struct clustered_hash
+{
+	size_t operator()(u32 key) const { return key / 5; };
+};
+
+template<typename Map, typename Reference>
+static bool has_same_entries(Map& map, Reference& reference)
+{
+	if (map.size() != reference.size())
+	{
+		return false;
+	}
+
+	bool same = true;
+	map.for_each([&](const auto& key, auto& value)
+	{
+		auto it = reference.find(key);
+		same = same && it != reference.end() && it->second == value;
+	});
+	return same;
+}
+
+// On the last block of a bump arena every growth stays in place, the arena holds only the final table
+static void grows_in_place_on_bump()
+{
+	memory_resource_manager os;
+	memory_resource resource = os.request_memory_from_os(4 * 1024 * 1024);
+	{
+		bump_memory_manager manager(&resource);
+		{
+			dap::flat_hash_map<u32, u32> map(manager);
+			for (u32 i = 0; i < 100000; ++i)
+			{
+				CHECK(map.try_emplace(i, i * 2) != nullptr);
+			}
+
+			size_t table_size = map.capacity() * sizeof(u32) * 2 + map.capacity() + 16;
+			CHECK(manager.get_statistics().memory_used <= table_size + 16);
+			CHECK(*map.find(77777) == 77777 * 2);
+		}
+		CHECK(manager.get_statistics().memory_used <= 16);
+	}
+	os.return_memory_to_os(resource);
+}
+
+// Another block behind the table makes every growth take a new block
+static void grows_into_new_block()
+{
+	fixed_memory_resource<1024 * 1024> resource;
+	bump_memory_manager manager(&resource);
+	dap::flat_hash_map<u32, u32> map(manager);
+	std::unordered_map<u32, u32> reference;
+
+	for (u32 i = 0; i < 5000; ++i)
+	{
+		size_t capacity = map.capacity();
+		CHECK(map.try_emplace(i, i + 1) != nullptr);
+		reference[i] = i + 1;
+		if (map.capacity() != capacity)
+		{
+			CHECK(manager.allocate(16, ACI).result == NEW_BLOCK);
+		}
+	}
+	CHECK(has_same_entries(map, reference));
+}
+
+// Erases leave tombstones, inserts rehash in place and have to keep every entry reachable
+static void rehash_keeps_entries()
+{
+	fixed_memory_resource<1024 * 1024> resource;
+	stack_memory_manager manager(&resource);
+	dap::flat_hash_map<u32, std::string, clustered_hash> map(manager);
+	std::unordered_map<u32, std::string> reference;
+
+	srand(7);
+	for (u32 i = 0; i < 200000; ++i)
+	{
+		u32 key = static_cast<u32>(rand()) % 600;
+		if (rand() % 2)
+		{
+			std::string value = std::to_string(key) + " long enough to live on the heap";
+			CHECK(map.try_emplace(key, value) != nullptr);
+			reference.try_emplace(key, value);
+		}
+		else
+		{
+			CHECK(map.erase(key) == (reference.erase(key) == 1));
+		}
+
+		if (i % 10000 == 0)
+		{
+			CHECK(has_same_entries(map, reference));
+		}
+	}
+
+	CHECK(has_same_entries(map, reference));
+	for (const auto& [key, value] : reference)
+	{
+		const std::string* found = map.find(key);
+		CHECK(found != nullptr && *found == value);
+	}
+	CHECK(map.capacity() <= 2048);
+}
+
+int main()
+{
+	grows_in_place_on_bump();
+	grows_into_new_block();
+	rehash_keeps_entries();
+	return failed_checks == 0 ? 0 : 1;
+}